@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_MAP_MIN_CAPACITY 16
+
+/* Finalizers of MurmurHash3 and SplitMix64, which mix into the low bits. */
+static inline size_t hash_u32(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6bU;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35U;
+	key ^= key >> 16;
+	return key;
+}
+
+static inline size_t hash_u64(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+#define hash_key(key)							\
+	_Generic((key),							\
+		 uint32_t: hash_u32,					\
+		 uint64_t: hash_u64)(key)
+
+/*
+ * Declares 'struct name', an open addressing hash map from @key_type to
+ * @value_type. A zeroed struct is an empty map. Headers that embed the
+ * map declare it, and the translation units that use it define it.
+ */
+#define DECLARE_HASH_MAP(name, key_type, value_type)			\
+struct name##_entry {							\
+	key_type key;							\
+	value_type value;						\
+	bool used;							\
+};									\
+									\
+struct name {								\
+	struct name##_entry *entries;					\
+	size_t nr_entries;						\
+	size_t capacity;						\
+}
+
+/*
+ * Defines name_find(), name_insert(), name_clear() and name_free() for a
+ * map declared with DECLARE_HASH_MAP(). The keys are hashed with
+ * hash_key() and probed linearly, and the map is kept at most half full.
+ */
+#define DEFINE_HASH_MAP(name, key_type, value_type)			\
+static inline struct name##_entry *					\
+name##_probe(struct name##_entry *entries, size_t capacity,		\
+	     key_type key)						\
+{									\
+	size_t mask = capacity - 1;					\
+	size_t i = hash_key(key) & mask;				\
+									\
+	while (entries[i].used && entries[i].key != key)		\
+		i = (i + 1) & mask;					\
+									\
+	return &entries[i];						\
+}									\
+									\
+static inline value_type *name##_find(const struct name *map,		\
+				      key_type key)			\
+{									\
+	struct name##_entry *entry;					\
+									\
+	if (!map->nr_entries)						\
+		return NULL;						\
+									\
+	entry = name##_probe(map->entries, map->capacity, key);	\
+	return entry->used ? &entry->value : NULL;			\
+}									\
+									\
+static inline bool name##_grow(struct name *map)			\
+{									\
+	struct name##_entry *entries, *entry;				\
+	size_t capacity, i;						\
+									\
+	capacity = map->capacity ? map->capacity * 2 :			\
+				   HASH_MAP_MIN_CAPACITY;		\
+	entries = calloc(capacity, sizeof(*entries));			\
+	if (!entries)							\
+		return false;						\
+									\
+	for (i = 0; i < map->capacity; i++) {				\
+		if (!map->entries[i].used)				\
+			continue;					\
+									\
+		entry = name##_probe(entries, capacity,			\
+				     map->entries[i].key);		\
+		*entry = map->entries[i];				\
+	}								\
+									\
+	free(map->entries);						\
+	map->entries = entries;						\
+	map->capacity = capacity;					\
+	return true;							\
+}									\
+									\
+/* Sets the value of @key, returning false when out of memory. */	\
+static inline bool name##_insert(struct name *map, key_type key,	\
+				 value_type value)			\
+{									\
+	struct name##_entry *entry;					\
+									\
+	if ((map->nr_entries + 1) * 2 > map->capacity &&		\
+	    !name##_grow(map))						\
+		return false;						\
+									\
+	entry = name##_probe(map->entries, map->capacity, key);	\
+	if (!entry->used) {						\
+		entry->used = true;					\
+		entry->key = key;					\
+		map->nr_entries++;					\
+	}								\
+									\
+	entry->value = value;						\
+	return true;							\
+}									\
+									\
+static inline void name##_clear(struct name *map)			\
+{									\
+	if (map->entries)						\
+		memset(map->entries, 0,					\
+		       map->capacity * sizeof(*map->entries));		\
+	map->nr_entries = 0;						\
+}									\
+									\
+static inline void name##_free(struct name *map)			\
+{									\
+	free(map->entries);						\
+	map->entries = NULL;						\
+	map->nr_entries = 0;						\
+	map->capacity = 0;						\
+}
+
+#endif /* HASH_MAP_H */
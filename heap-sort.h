@@ -8,8 +8,57 @@
 
 #include <stddef.h>
 
-typedef int (*heap_sort_cmp_t)(const void *a, const void *b);
-void heap_sort(void *base, void *scratch, size_t nr_elements,
-	       size_t element_size, heap_sort_cmp_t cmp);
+/*
+ * Defines 'static inline void name(type *base, size_t nr_elements)', which
+ * heap sorts the array in place. @less(a, b) takes two 'const type *' and
+ * is true when a orders before b. It is expanded at every comparison, so a
+ * static inline function or a macro lets the compiler inline it, and the
+ * elements are moved by assignment instead of a memcpy() of a runtime size.
+ */
+#define DEFINE_HEAP_SORT(name, type, less)				\
+/* Moves larger children up into the hole at @root and fills it last. */ \
+static inline void name##_sift_down(type *base, size_t root,		\
+				    size_t end, const type *value)	\
+{									\
+	size_t child;							\
+									\
+	while ((root * 2) + 1 <= end) {					\
+		child = (root * 2) + 1;					\
+									\
+		if (child + 1 <= end &&					\
+		    less(&base[child], &base[child + 1]))		\
+			child++;					\
+									\
+		if (!less(value, &base[child]))				\
+			break;						\
+									\
+		base[root] = base[child];				\
+		root = child;						\
+	}								\
+									\
+	base[root] = *value;						\
+}									\
+									\
+static inline void name(type *base, size_t nr_elements)		\
+{									\
+	type scratch;							\
+	size_t start;							\
+	size_t end;							\
+									\
+	if (nr_elements < 2)						\
+		return;							\
+									\
+	for (start = nr_elements / 2; start-- > 0;) {			\
+		scratch = base[start];					\
+		name##_sift_down(base, start, nr_elements - 1,		\
+				 &scratch);				\
+	}								\
+									\
+	for (end = nr_elements - 1; end > 0; end--) {			\
+		scratch = base[end];					\
+		base[end] = base[0];					\
+		name##_sift_down(base, 0, end - 1, &scratch);		\
+	}								\
+}
 
 #endif /* HEAPSORT_H */
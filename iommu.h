@@ -8,23 +8,318 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+#include "hash-map.h"
 #include "pci.h"
-#include "string-buffer.h"
 
-#define IOMMU_GROUP_NR_DEVICES 32
+struct output;
+
+enum iommu_read_flag {
+	IOMMU_READ_LOCALITY = 0x01,
+	IOMMU_READ_NUMA_FILTER = 0x02,
+	IOMMU_READ_VFIO = 0x04,
+	IOMMU_READ_REGIONS = 0x08,
+	IOMMU_READ_GROUPS = 0x10,
+	IOMMU_READ_LIMIT = 0x20,
+	IOMMU_READ_ACS = 0x40,
+	IOMMU_READ_FINGERPRINT = 0x80,
+};
+
+/* Optional attributes, which are all covered by the fingerprint. */
+#define IOMMU_READ_ATTRIBUTES						\
+	(IOMMU_READ_LOCALITY | IOMMU_READ_VFIO | IOMMU_READ_REGIONS |	\
+	 IOMMU_READ_ACS)
+
+/*
+ * IOMMU_READ_GROUPS reads only the groups from first_group to last_group,
+ * and IOMMU_READ_LIMIT only the first limit groups of the result.
+ * IOMMU_READ_FINGERPRINT sets the fingerprint of the list, for which every
+ * optional attribute is read and then dropped unless it was requested.
+ */
+struct iommu_read_options {
+	unsigned int flags;
+	int numa_node;
+	unsigned int first_group;
+	unsigned int last_group;
+	unsigned int limit;
+};
+
+/* Readiness of a group for VFIO passthrough, set with IOMMU_READ_VFIO. */
+enum iommu_vfio_state {
+	IOMMU_VFIO_UNKNOWN = 0,
+	IOMMU_VFIO_BOUND,
+	IOMMU_VFIO_BINDABLE,
+	IOMMU_VFIO_NO_ENDPOINTS,
+	IOMMU_VFIO_HOST_CRITICAL,
+};
+
+/* Types of /sys/kernel/iommu_groups/<id>/reserved_regions. */
+enum iommu_region_type {
+	IOMMU_REGION_DIRECT,
+	IOMMU_REGION_DIRECT_RELAXABLE,
+	IOMMU_REGION_RESERVED,
+	IOMMU_REGION_MSI,
+	IOMMU_REGION_SW_MSI,
+	IOMMU_REGION_UNKNOWN,
+};
+
+/*
+ * Reserved region with inclusive bounds. Arrays of regions are sorted by
+ * start, and max_end is set only in a struct iommu_region_index.
+ */
+struct iommu_region {
+	uint64_t start;
+	uint64_t end;
+	uint64_t max_end;
+	unsigned int group_id;
+	enum iommu_region_type type;
+};
+
+/* A bridge above a group and its ACS registers, read with IOMMU_READ_ACS. */
+struct iommu_bridge {
+	uint32_t addr;
+	struct pci_acs acs;
+};
 
 struct iommu_group {
 	unsigned int group_id;
 	unsigned int nr_devices;
-	struct pci_device devices[IOMMU_GROUP_NR_DEVICES];
+	unsigned int capacity;
+	enum iommu_vfio_state vfio;
+	struct pci_device *devices;
+	bool has_regions;
+	unsigned int nr_regions;
+	struct iommu_region *regions;
+	bool has_upstream;
+	unsigned int nr_upstream;
+	struct iommu_bridge *upstream;
+};
+
+/*
+ * Regions of all groups in one sorted array, which is also an implicit
+ * interval tree where max_end is the largest end in the subtree.
+ */
+struct iommu_region_index {
+	struct iommu_region *regions;
+	size_t nr_regions;
+};
+
+/*
+ * Attributes that the virtual functions share with their physical function.
+ * @device is the device ID of the virtual functions.
+ */
+struct iommu_physfn {
+	unsigned int nr_virtfn;
+	bool has_revision;
+	char class[PCI_PROPERTY_SIZE];
+	char vendor[PCI_PROPERTY_SIZE];
+	char device[PCI_PROPERTY_SIZE];
+	char revision[PCI_PROPERTY_SIZE];
 };
 
-bool iommu_groups_read(struct iommu_group *groups, unsigned int *cnt,
-		       unsigned int capacity);
+DECLARE_HASH_MAP(iommu_group_map, uint32_t, unsigned int);
+DECLARE_HASH_MAP(iommu_physfn_map, uint32_t, struct iommu_physfn);
+
+/*
+ * Growable array of groups filled by a discovery backend. The map from
+ * group IDs to indices is checked and rebuilt on lookup, so that the
+ * array can be sorted and filtered without updating it. The physical
+ * functions are collected while reading, and physfn_missed is set when
+ * one of them could not be added to the map.
+ */
+struct iommu_groups {
+	struct iommu_group *groups;
+	unsigned int nr_groups;
+	unsigned int capacity;
+	struct iommu_group_map map;
+	struct iommu_physfn_map physfns;
+	bool physfn_missed;
+	uint64_t fingerprint;
+};
+
+struct iommu_group *iommu_groups_get(struct iommu_groups *list,
+				     unsigned int group_id);
+bool iommu_group_add_device(struct iommu_group *group,
+			    const struct pci_device *dev);
+struct iommu_physfn *iommu_groups_find_physfn(const struct iommu_groups *list,
+					      uint32_t addr);
+struct iommu_physfn *iommu_groups_add_physfn(struct iommu_groups *list,
+					     uint32_t addr,
+					     const struct iommu_physfn *pf);
+void iommu_groups_release_physfns(struct iommu_groups *list);
+void iommu_group_free(struct iommu_group *group);
+void iommu_groups_free(struct iommu_groups *list);
+
+/*
+ * Discovery backend. available() must be cheap, as it is used to
+ * auto-select the backend, and read() fills @list without sorting it.
+ * The optional read_groups() is used instead for IOMMU_READ_GROUPS and
+ * IOMMU_READ_LIMIT, and opens only the directories of the groups read.
+ */
+struct iommu_backend {
+	const char *name;
+	bool (*available)(void);
+	bool (*read)(const struct iommu_read_options *opts,
+		     struct iommu_groups *list);
+	bool (*read_groups)(const struct iommu_read_options *opts,
+			    struct iommu_groups *list);
+};
+
+extern const struct iommu_backend iommu_sysfs_backend;
+extern const struct iommu_backend iommu_udev_backend;
+
+const struct iommu_backend *iommu_backend_find(const char *name);
+bool iommu_groups_read(const struct iommu_backend *backend,
+		       const struct iommu_read_options *opts,
+		       struct iommu_groups *list);
+bool iommu_read_wants_group(const struct iommu_read_options *opts,
+			    unsigned int group_id);
+int iommu_group_ids_read(const struct iommu_read_options *opts,
+			 unsigned int **ids);
+int iommu_group_ids_limit(struct iommu_read_options *opts);
+int iommu_read_virtfn(struct iommu_groups *list, const char *dev_path,
+		      struct pci_device *dev);
+void iommu_read_device_extras(const struct iommu_read_options *opts,
+			      const char *dev_path, struct pci_device *dev);
+void iommu_groups_link_sriov(const struct iommu_read_options *opts,
+			     struct iommu_groups *list);
+void iommu_groups_vfio_state(struct iommu_group *groups,
+			     unsigned int nr_groups);
+const char *iommu_vfio_state_name(enum iommu_vfio_state state);
+enum iommu_vfio_state iommu_vfio_state_from_name(const char *name);
 void iommu_groups_sort(struct iommu_group *groups, unsigned int nr_groups);
-const struct string_buffer *iommu_to_json(struct iommu_group *groups,
-					  unsigned int nr_groups);
+void iommu_groups_read_regions(struct iommu_group *groups,
+			       unsigned int nr_groups);
+int iommu_groups_read_acs(struct iommu_group *groups, unsigned int nr_groups);
+const char *iommu_region_type_name(enum iommu_region_type type);
+void iommu_region_write_json(struct output *out,
+			     const struct iommu_region *region);
+int iommu_region_index_build(struct iommu_region_index *index,
+			     const struct iommu_group *groups,
+			     unsigned int nr_groups);
+void iommu_region_index_free(struct iommu_region_index *index);
+uint64_t iommu_groups_fingerprint(const struct iommu_group *groups,
+				  unsigned int nr_groups);
+/*
+ * Output format callbacks driven by iommu_emit(). Every callback except
+ * device() is optional. An emitter with @fingerprint set writes the
+ * fingerprint of the list, which must be read with IOMMU_READ_FINGERPRINT.
+ */
+struct iommu_emitter {
+	const char *name;
+	bool fingerprint;
+	void (*begin)(struct output *out, const struct iommu_groups *list);
+	void (*group_begin)(struct output *out, struct iommu_group *group,
+			    unsigned int index);
+	void (*device)(struct output *out, struct iommu_group *group,
+		       struct pci_device *dev, unsigned int index);
+	void (*group_end)(struct output *out, struct iommu_group *group,
+			  unsigned int index);
+	void (*end)(struct output *out, const struct iommu_groups *list);
+};
+
+extern const struct iommu_emitter iommu_plain_emitter;
+extern const struct iommu_emitter iommu_json_emitter;
+extern const struct iommu_emitter iommu_ndjson_emitter;
+extern const struct iommu_emitter iommu_cbor_emitter;
+
+const struct iommu_emitter *iommu_emitter_find(const char *name);
+int iommu_emit(const struct iommu_emitter *emitter, struct output *out,
+	       const struct iommu_groups *list);
+int iommu_emit_parallel(const struct iommu_emitter *emitter, int fd,
+			const struct iommu_groups *list, unsigned int nr_jobs);
+void iommu_json_append_string(struct output *out, const char *str);
+
+int iommu_groups_load(int fd, struct iommu_groups *list);
+
+/* Formats of the one-record-per-change output of --diff and --aggregate. */
+enum iommu_record_style {
+	IOMMU_RECORD_PLAIN,
+	IOMMU_RECORD_JSON,
+	IOMMU_RECORD_NDJSON,
+};
+
+int iommu_diff(struct output *out, enum iommu_record_style style,
+	       const struct iommu_groups *old, const struct iommu_groups *new);
+int iommu_check_range(struct output *out, enum iommu_record_style style,
+		      const struct iommu_region_index *index, uint64_t start,
+		      uint64_t end);
+
+#define IOMMU_SELECT_FILTERS 8
+#define IOMMU_SELECT_PATTERN_SIZE 64
+
+/* fnmatch() pattern for one field, such as the "class=03*" in "[...]". */
+struct iommu_select_filter {
+	unsigned int field;
+	bool negate;
+	char pattern[IOMMU_SELECT_PATTERN_SIZE];
+};
+
+/*
+ * Compiled --select expression. A negative field selects whole groups or
+ * devices instead of one of their fields.
+ */
+struct iommu_selector {
+	struct iommu_select_filter group_filters[IOMMU_SELECT_FILTERS];
+	unsigned int nr_group_filters;
+	bool devices;
+	struct iommu_select_filter device_filters[IOMMU_SELECT_FILTERS];
+	unsigned int nr_device_filters;
+	int field;
+};
+
+int iommu_selector_compile(const char *expr, struct iommu_selector *sel);
+int iommu_select(struct output *out, enum iommu_record_style style,
+		 const struct iommu_selector *sel, struct iommu_group *groups,
+		 unsigned int nr_groups);
+
+/* Snapshot of one host, named after its file, loaded by --aggregate. */
+struct iommu_host {
+	char *name;
+	int error;
+	struct iommu_groups list;
+};
+
+/* A device of a host, filed under a vendor:device or class key. */
+struct iommu_posting {
+	uint32_t key;
+	unsigned int host;
+	unsigned int group;
+	unsigned int device;
+};
+
+/*
+ * Snapshots of many hosts and their inverted indexes, sorted by key and
+ * then by host, group and device.
+ */
+struct iommu_fleet {
+	struct iommu_host *hosts;
+	unsigned int nr_hosts;
+	struct iommu_posting *by_id;
+	struct iommu_posting *by_class;
+	size_t nr_postings;
+};
+
+enum iommu_query_flag {
+	IOMMU_QUERY_ID = 0x01,
+	IOMMU_QUERY_CLASS = 0x02,
+	IOMMU_QUERY_SHARED = 0x04,
+};
+
+struct iommu_query {
+	unsigned int flags;
+	uint32_t id;
+	uint32_t class_first;
+	uint32_t class_last;
+};
+
+int iommu_fleet_load(struct iommu_fleet *fleet, const char *dir,
+		     unsigned int nr_jobs);
+void iommu_fleet_free(struct iommu_fleet *fleet);
+int iommu_fleet_query(struct output *out, enum iommu_record_style style,
+		      const struct iommu_fleet *fleet,
+		      const struct iommu_query *query);
 
 #endif /* IOMMU_H */
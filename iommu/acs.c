@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash-map.h"
+#include "iommu.h"
+#include "pci.h"
+#include "sysfs-file.h"
+
+#define SYSFS_PCI_DEVICES "/sys/bus/pci/devices"
+#define IOMMU_MAX_UPSTREAM 32
+
+DECLARE_HASH_MAP(pci_acs_map, uint32_t, struct pci_acs);
+DEFINE_HASH_MAP(pci_acs_map, uint32_t, struct pci_acs)
+
+static void iommu_device_path(uint32_t addr, char *path)
+{
+	memcpy(path, SYSFS_PCI_DEVICES "/", sizeof(SYSFS_PCI_DEVICES));
+	pci_addr_to_string(addr, path + sizeof(SYSFS_PCI_DEVICES),
+			   PCI_ADDR_STRING_SIZE);
+}
+
+/*
+ * Reads the whole configuration space once and walks it in memory. @cache
+ * maps addresses to registers, so that a shared bridge is read only once.
+ */
+static struct pci_acs iommu_acs_read(struct pci_acs_map *cache, uint32_t addr)
+{
+	char path[sizeof(SYSFS_PCI_DEVICES) + PCI_ADDR_STRING_SIZE];
+	uint8_t config[PCI_CONFIG_SIZE];
+	struct pci_acs acs = { 0 };
+	struct pci_acs *cached;
+	ssize_t len;
+
+	cached = pci_acs_map_find(cache, addr);
+	if (cached)
+		return *cached;
+
+	iommu_device_path(addr, path);
+	len = sysfs_read_binary(path, "config", config, sizeof(config));
+	if (len > 0)
+		pci_config_read_acs(config, len, &acs);
+
+	/* Without memory, the bridge is only read again. */
+	pci_acs_map_insert(cache, addr, acs);
+	return acs;
+}
+
+/*
+ * Fills @path with the functions above the device, from the root port
+ * down, as they appear in its canonical sysfs path. Returns their number
+ * or a negative error.
+ */
+static int iommu_read_upstream(uint32_t addr, uint32_t *path)
+{
+	char dev_path[sizeof(SYSFS_PCI_DEVICES) + PCI_ADDR_STRING_SIZE];
+	char *real, *name, *saveptr;
+	uint32_t bridge;
+	int nr = 0;
+
+	iommu_device_path(addr, dev_path);
+	real = realpath(dev_path, NULL);
+	if (!real)
+		return -errno;
+
+	for (name = strtok_r(real, "/", &saveptr); name;
+	     name = strtok_r(NULL, "/", &saveptr)) {
+		if (pci_string_to_addr(name, &bridge) < 0)
+			continue;
+
+		if (bridge == addr)
+			break;
+
+		if (nr == IOMMU_MAX_UPSTREAM) {
+			nr = -E2BIG;
+			break;
+		}
+
+		path[nr++] = bridge;
+	}
+
+	free(real);
+	return nr;
+}
+
+/*
+ * Reads the ACS registers of the devices, and of the bridges above the
+ * topmost device of the group, which are the ones that isolate it.
+ */
+static int iommu_group_read_acs(struct pci_acs_map *cache,
+				struct iommu_group *group)
+{
+	uint32_t path[IOMMU_MAX_UPSTREAM], upstream[IOMMU_MAX_UPSTREAM];
+	struct pci_device *dev;
+	int nr, nr_upstream = -1;
+	unsigned int i;
+
+	for (i = 0; i < group->nr_devices; i++) {
+		dev = &group->devices[i];
+		if (!dev->valid)
+			continue;
+
+		dev->acs = iommu_acs_read(cache, dev->addr);
+
+		nr = iommu_read_upstream(dev->addr, path);
+		if (nr >= 0 && (nr_upstream < 0 || nr < nr_upstream)) {
+			memcpy(upstream, path, nr * sizeof(path[0]));
+			nr_upstream = nr;
+		}
+	}
+
+	if (nr_upstream < 0)
+		return 0;
+
+	/* A group of a root bus has no bridges above it. */
+	if (nr_upstream > 0) {
+		group->upstream = malloc(nr_upstream *
+					 sizeof(*group->upstream));
+		if (!group->upstream)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < (unsigned int)nr_upstream; i++) {
+		group->upstream[i].addr = upstream[i];
+		group->upstream[i].acs = iommu_acs_read(cache, upstream[i]);
+	}
+
+	group->nr_upstream = nr_upstream;
+	group->has_upstream = true;
+	return 0;
+}
+
+/* Returns 0, or a negative error when a group could not be read. */
+int iommu_groups_read_acs(struct iommu_group *groups, unsigned int nr_groups)
+{
+	struct pci_acs_map cache = { 0 };
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < nr_groups && !ret; i++)
+		ret = iommu_group_read_acs(&cache, &groups[i]);
+
+	pci_acs_map_free(&cache);
+	return ret;
+}
@@ -0,0 +1,450 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heap-sort.h"
+#include "iommu.h"
+#include "output.h"
+#include "pci.h"
+
+struct iommu_fleet_loader {
+	int dir_fd;
+	struct iommu_host *hosts;
+	unsigned int nr_hosts;
+	atomic_uint next;
+};
+
+static inline bool iommu_host_less(const struct iommu_host *a,
+				   const struct iommu_host *b)
+{
+	return strcmp(a->name, b->name) < 0;
+}
+
+/* Orders matches by host, group and device, ignoring the key. */
+static inline bool iommu_match_less(const struct iommu_posting *a,
+				    const struct iommu_posting *b)
+{
+	if (a->host != b->host)
+		return a->host < b->host;
+	if (a->group != b->group)
+		return a->group < b->group;
+	return a->device < b->device;
+}
+
+static inline bool iommu_posting_less(const struct iommu_posting *a,
+				      const struct iommu_posting *b)
+{
+	if (a->key != b->key)
+		return a->key < b->key;
+	return iommu_match_less(a, b);
+}
+
+DEFINE_HEAP_SORT(iommu_hosts_sort, struct iommu_host, iommu_host_less)
+DEFINE_HEAP_SORT(iommu_postings_sort, struct iommu_posting, iommu_posting_less)
+DEFINE_HEAP_SORT(iommu_matches_sort, struct iommu_posting, iommu_match_less)
+
+static int iommu_fleet_list(struct iommu_fleet *fleet, DIR *dir)
+{
+	struct iommu_host *hosts, *host;
+	unsigned int capacity = 0;
+	struct dirent *entry;
+
+	for (;;) {
+		errno = 0;
+		entry = readdir(dir);
+		if (!entry)
+			return -errno;
+
+		if (entry->d_name[0] == '.')
+			continue;
+
+		if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+		    entry->d_type != DT_UNKNOWN)
+			continue;
+
+		if (fleet->nr_hosts == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			hosts = realloc(fleet->hosts,
+					capacity * sizeof(*hosts));
+			if (!hosts)
+				return -ENOMEM;
+
+			fleet->hosts = hosts;
+		}
+
+		host = &fleet->hosts[fleet->nr_hosts];
+		memset(host, 0, sizeof(*host));
+		host->name = strdup(entry->d_name);
+		if (!host->name)
+			return -ENOMEM;
+
+		fleet->nr_hosts++;
+	}
+}
+
+static void iommu_fleet_load_host(int dir_fd, struct iommu_host *host)
+{
+	int fd;
+
+	fd = openat(dir_fd, host->name, O_RDONLY);
+	if (fd < 0) {
+		host->error = -errno;
+		return;
+	}
+
+	host->error = iommu_groups_load(fd, &host->list);
+	close(fd);
+
+	if (host->error) {
+		iommu_groups_free(&host->list);
+		return;
+	}
+
+	iommu_groups_sort(host->list.groups, host->list.nr_groups);
+}
+
+static void *iommu_fleet_worker(void *arg)
+{
+	struct iommu_fleet_loader *loader = arg;
+	unsigned int i;
+
+	for (;;) {
+		i = atomic_fetch_add(&loader->next, 1);
+		if (i >= loader->nr_hosts)
+			break;
+
+		iommu_fleet_load_host(loader->dir_fd, &loader->hosts[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Loads the files on @nr_jobs threads, including the calling thread, or on
+ * one thread per online CPU if @nr_jobs is zero. If a thread cannot be
+ * created, the remaining threads take over its share.
+ */
+static void iommu_fleet_load_hosts(struct iommu_fleet *fleet, int dir_fd,
+				   unsigned int nr_jobs)
+{
+	struct iommu_fleet_loader loader = {
+		.dir_fd = dir_fd,
+		.hosts = fleet->hosts,
+		.nr_hosts = fleet->nr_hosts,
+	};
+	unsigned int nr_threads = 0;
+	pthread_t *threads;
+	long nr_cpus;
+
+	atomic_init(&loader.next, 0);
+
+	if (nr_jobs == 0) {
+		nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nr_jobs = nr_cpus > 0 ? nr_cpus : 1;
+	}
+
+	if (nr_jobs > fleet->nr_hosts)
+		nr_jobs = fleet->nr_hosts;
+
+	threads = nr_jobs > 1 ? calloc(nr_jobs - 1, sizeof(*threads)) : NULL;
+	if (threads) {
+		for (; nr_threads < nr_jobs - 1; nr_threads++)
+			if (pthread_create(&threads[nr_threads], NULL,
+					   iommu_fleet_worker, &loader))
+				break;
+	}
+
+	iommu_fleet_worker(&loader);
+
+	while (nr_threads > 0)
+		pthread_join(threads[--nr_threads], NULL);
+
+	free(threads);
+}
+
+/* Names hosts after their files, without a .json or .ndjson suffix. */
+static void iommu_host_strip_suffix(struct iommu_host *host)
+{
+	static const char *const suffixes[] = { ".ndjson", ".json" };
+	size_t len = strlen(host->name);
+	size_t suffix_len;
+	size_t i;
+
+	for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+		suffix_len = strlen(suffixes[i]);
+		if (len > suffix_len &&
+		    strcmp(host->name + len - suffix_len, suffixes[i]) == 0) {
+			host->name[len - suffix_len] = '\0';
+			return;
+		}
+	}
+}
+
+static int iommu_fleet_index(struct iommu_fleet *fleet)
+{
+	struct iommu_posting *id, *class;
+	const struct iommu_group *group;
+	const struct pci_device *dev;
+	uint32_t vendor, device, value;
+	unsigned int i, j, k;
+	size_t nr_postings = 0;
+
+	for (i = 0; i < fleet->nr_hosts; i++)
+		for (j = 0; j < fleet->hosts[i].list.nr_groups; j++)
+			nr_postings += fleet->hosts[i].list.groups[j].nr_devices;
+
+	fleet->by_id = NULL;
+	fleet->by_class = NULL;
+	fleet->nr_postings = 0;
+	if (!nr_postings)
+		return 0;
+
+	id = malloc(nr_postings * sizeof(*id));
+	class = malloc(nr_postings * sizeof(*class));
+	if (!id || !class) {
+		free(id);
+		free(class);
+		return -ENOMEM;
+	}
+
+	fleet->by_id = id;
+	fleet->by_class = class;
+
+	for (i = 0; i < fleet->nr_hosts; i++) {
+		for (j = 0; j < fleet->hosts[i].list.nr_groups; j++) {
+			group = &fleet->hosts[i].list.groups[j];
+
+			for (k = 0; k < group->nr_devices; k++) {
+				dev = &group->devices[k];
+				if (!dev->valid ||
+				    pci_property_to_u32(dev->vendor, &vendor) ||
+				    pci_property_to_u32(dev->device, &device) ||
+				    pci_property_to_u32(dev->class, &value))
+					continue;
+
+				id->key = (vendor & 0xffff) << 16 |
+					  (device & 0xffff);
+				id->host = i;
+				id->group = j;
+				id->device = k;
+
+				*class = *id;
+				class->key = value;
+
+				id++;
+				class++;
+			}
+		}
+	}
+
+	fleet->nr_postings = id - fleet->by_id;
+
+	iommu_postings_sort(fleet->by_id, fleet->nr_postings);
+	iommu_postings_sort(fleet->by_class, fleet->nr_postings);
+	return 0;
+}
+
+/*
+ * Loads every file in @dir as a json or ndjson snapshot of one host and
+ * indexes the devices. A file that cannot be loaded does not fail the
+ * whole fleet: its host is kept with the error set and without groups.
+ */
+int iommu_fleet_load(struct iommu_fleet *fleet, const char *dir,
+		     unsigned int nr_jobs)
+{
+	unsigned int i;
+	DIR *d;
+	int ret;
+
+	d = opendir(dir);
+	if (!d)
+		return -errno;
+
+	ret = iommu_fleet_list(fleet, d);
+	if (ret) {
+		closedir(d);
+		return ret;
+	}
+
+	iommu_hosts_sort(fleet->hosts, fleet->nr_hosts);
+
+	iommu_fleet_load_hosts(fleet, dirfd(d), nr_jobs);
+	closedir(d);
+
+	for (i = 0; i < fleet->nr_hosts; i++)
+		iommu_host_strip_suffix(&fleet->hosts[i]);
+
+	return iommu_fleet_index(fleet);
+}
+
+void iommu_fleet_free(struct iommu_fleet *fleet)
+{
+	unsigned int i;
+
+	for (i = 0; i < fleet->nr_hosts; i++) {
+		free(fleet->hosts[i].name);
+		iommu_groups_free(&fleet->hosts[i].list);
+	}
+
+	free(fleet->hosts);
+	free(fleet->by_id);
+	free(fleet->by_class);
+	memset(fleet, 0, sizeof(*fleet));
+}
+
+/* Returns the first posting with a key of at least @key. */
+static size_t iommu_posting_lower_bound(const struct iommu_posting *postings,
+					size_t nr_postings, uint32_t key)
+{
+	size_t low = 0, high = nr_postings, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (postings[mid].key < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static void iommu_fleet_record(struct output *out,
+			       enum iommu_record_style style,
+			       const struct iommu_fleet *fleet,
+			       const struct iommu_posting *match,
+			       unsigned int index)
+{
+	const struct iommu_host *host = &fleet->hosts[match->host];
+	const struct iommu_group *group = &host->list.groups[match->group];
+	const struct pci_device *dev = &group->devices[match->device];
+
+	if (style == IOMMU_RECORD_PLAIN) {
+		output_pci_addr(out, dev->addr);
+		output_str(out, " host ");
+		output_str(out, host->name);
+		output_str(out, " group ");
+		output_dec(out, group->group_id, 0);
+		output_str(out, " vendor ");
+		output_str(out, dev->vendor + 2);
+		output_str(out, " device ");
+		output_str(out, dev->device + 2);
+		output_str(out, " class ");
+		output_str(out, dev->class + 2);
+		output_str(out, " group_devices ");
+		output_dec(out, group->nr_devices, 0);
+		output_char(out, '\n');
+		return;
+	}
+
+	if (style == IOMMU_RECORD_JSON && index > 0)
+		output_char(out, ',');
+
+	output_str(out, "{\"address\":\"");
+	output_pci_addr(out, dev->addr);
+	output_str(out, "\",\"host\":");
+	iommu_json_append_string(out, host->name);
+	output_str(out, ",\"group\":");
+	output_dec(out, group->group_id, 0);
+	output_str(out, ",\"vendor\":");
+	iommu_json_append_string(out, dev->vendor + 2);
+	output_str(out, ",\"device\":");
+	iommu_json_append_string(out, dev->device + 2);
+	output_str(out, ",\"class\":");
+	iommu_json_append_string(out, dev->class + 2);
+	output_str(out, ",\"group_devices\":");
+	output_dec(out, group->nr_devices, 0);
+	output_str(out, style == IOMMU_RECORD_JSON ? "}" : "}\n");
+}
+
+static bool iommu_query_match(const struct iommu_fleet *fleet,
+			      const struct iommu_query *query,
+			      const struct iommu_posting *posting)
+{
+	const struct iommu_group *group;
+	uint32_t class;
+
+	group = &fleet->hosts[posting->host].list.groups[posting->group];
+
+	if (query->flags & IOMMU_QUERY_CLASS) {
+		if (pci_property_to_u32(group->devices[posting->device].class,
+					&class) ||
+		    class < query->class_first || class > query->class_last)
+			return false;
+	}
+
+	if ((query->flags & IOMMU_QUERY_SHARED) && group->nr_devices < 2)
+		return false;
+
+	return true;
+}
+
+/*
+ * Writes the devices that match @query, ordered by host, group and address.
+ * A vendor:device or class query is answered from the matching range of
+ * its index. Returns the number of matches or a negative error.
+ */
+int iommu_fleet_query(struct output *out, enum iommu_record_style style,
+		      const struct iommu_fleet *fleet,
+		      const struct iommu_query *query)
+{
+	const struct iommu_posting *postings = fleet->by_id;
+	struct iommu_posting *matches = NULL;
+	size_t first = 0, last = fleet->nr_postings;
+	size_t i, nr_matches = 0;
+
+	if (query->flags & IOMMU_QUERY_ID) {
+		first = iommu_posting_lower_bound(postings, last, query->id);
+		if (query->id < UINT32_MAX)
+			last = iommu_posting_lower_bound(postings, last,
+							 query->id + 1);
+	} else if (query->flags & IOMMU_QUERY_CLASS) {
+		postings = fleet->by_class;
+		first = iommu_posting_lower_bound(postings, last,
+						  query->class_first);
+		last = iommu_posting_lower_bound(postings, last,
+						 query->class_last + 1);
+	}
+
+	if (last > first) {
+		matches = malloc((last - first) * sizeof(*matches));
+		if (!matches)
+			return -ENOMEM;
+	}
+
+	for (i = first; i < last; i++)
+		if (iommu_query_match(fleet, query, &postings[i]))
+			matches[nr_matches++] = postings[i];
+
+	iommu_matches_sort(matches, nr_matches);
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "{\"matches\":[");
+
+	for (i = 0; i < nr_matches; i++)
+		iommu_fleet_record(out, style, fleet, &matches[i], i);
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "]}\n");
+
+	free(matches);
+
+	if (out->error)
+		return out->error;
+
+	return nr_matches;
+}
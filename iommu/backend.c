@@ -0,0 +1,381 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heap-sort.h"
+#include "iommu.h"
+#include "pci.h"
+#include "string-buffer.h"
+
+#define SYSFS_PCI_DEVICES "/sys/bus/pci/devices"
+#define SYSFS_IOMMU_GROUPS "/sys/kernel/iommu_groups"
+
+/* Ordered from the cheapest to the most expensive to start up. */
+static const struct iommu_backend *iommu_backends[] = {
+	&iommu_sysfs_backend,
+	&iommu_udev_backend,
+};
+
+#define IOMMU_NR_BACKENDS (sizeof(iommu_backends) / sizeof(iommu_backends[0]))
+
+const struct iommu_backend *iommu_backend_find(const char *name)
+{
+	size_t i;
+
+	if (strcmp(name, "auto") == 0) {
+		for (i = 0; i < IOMMU_NR_BACKENDS; i++)
+			if (iommu_backends[i]->available())
+				return iommu_backends[i];
+
+		return NULL;
+	}
+
+	for (i = 0; i < IOMMU_NR_BACKENDS; i++)
+		if (strcmp(iommu_backends[i]->name, name) == 0)
+			return iommu_backends[i];
+
+	return NULL;
+}
+
+static bool iommu_group_on_node(const struct iommu_group *group, int node)
+{
+	const struct pci_device *dev;
+	unsigned int i;
+
+	for (i = 0; i < group->nr_devices; i++) {
+		dev = &group->devices[i];
+		if (dev->valid && (dev->locality.flags & PCI_LOCALITY_NUMA) &&
+		    dev->locality.numa_node == node)
+			return true;
+	}
+
+	return false;
+}
+
+/* Drops the groups that have no device on the NUMA node. */
+static void iommu_groups_filter_numa(struct iommu_groups *list, int node)
+{
+	struct iommu_group *groups = list->groups;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < list->nr_groups; i++) {
+		if (!iommu_group_on_node(&groups[i], node)) {
+			iommu_group_free(&groups[i]);
+			continue;
+		}
+
+		if (i != n)
+			memcpy(&groups[n], &groups[i], sizeof(groups[i]));
+		n++;
+	}
+
+	list->nr_groups = n;
+}
+
+/* Drops the groups after the first @limit of the sorted list. */
+static void iommu_groups_truncate(struct iommu_groups *list,
+				  unsigned int limit)
+{
+	unsigned int i;
+
+	for (i = limit; i < list->nr_groups; i++)
+		iommu_group_free(&list->groups[i]);
+
+	if (list->nr_groups > limit)
+		list->nr_groups = limit;
+}
+
+/* Whether a device-centric backend should read the devices of a group. */
+bool iommu_read_wants_group(const struct iommu_read_options *opts,
+			    unsigned int group_id)
+{
+	return !(opts->flags & IOMMU_READ_GROUPS) ||
+	       (group_id >= opts->first_group &&
+		group_id <= opts->last_group);
+}
+
+static inline bool group_id_less(const unsigned int *a, const unsigned int *b)
+{
+	return *a < *b;
+}
+
+DEFINE_HEAP_SORT(group_ids_sort, unsigned int, group_id_less)
+
+/*
+ * Returns the number of groups in /sys/kernel/iommu_groups selected by the
+ * group range of @opts, with their IDs sorted in @ids, or a negative
+ * error. A range of one group is returned without listing the directory.
+ */
+int iommu_group_ids_read(const struct iommu_read_options *opts,
+			 unsigned int **ids)
+{
+	unsigned int first = 0, last = UINT_MAX;
+	unsigned int *array, capacity = 0;
+	struct dirent *entry;
+	unsigned long id;
+	char *endptr;
+	int nr = 0, ret = 0;
+	DIR *dir;
+
+	if (opts->flags & IOMMU_READ_GROUPS) {
+		first = opts->first_group;
+		last = opts->last_group;
+	}
+
+	*ids = NULL;
+	if (first == last) {
+		*ids = malloc(sizeof(**ids));
+		if (!*ids)
+			return -ENOMEM;
+
+		**ids = first;
+		return 1;
+	}
+
+	dir = opendir(SYSFS_IOMMU_GROUPS);
+	if (!dir)
+		return -errno;
+
+	for (;;) {
+		errno = 0;
+		entry = readdir(dir);
+		if (!entry) {
+			if (errno)
+				ret = -errno;
+			break;
+		}
+
+		errno = 0;
+		id = strtoul(entry->d_name, &endptr, 10);
+		if (errno || endptr == entry->d_name || *endptr != '\0' ||
+		    id < first || id > last)
+			continue;
+
+		if ((unsigned int)nr == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			array = realloc(*ids, capacity * sizeof(*array));
+			if (!array) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			*ids = array;
+		}
+
+		(*ids)[nr++] = id;
+	}
+
+	closedir(dir);
+
+	if (ret) {
+		free(*ids);
+		*ids = NULL;
+		return ret;
+	}
+
+	group_ids_sort(*ids, nr);
+	return nr;
+}
+
+/* Returns 1 if the group has a PCI device, 0 if not, or a negative error. */
+static int iommu_group_has_pci_device(unsigned int group_id)
+{
+	char path[sizeof(SYSFS_IOMMU_GROUPS) + 32];
+	STRING_BUFFER(buf, PATH_MAX);
+	struct dirent *entry;
+	uint32_t addr;
+	int ret = 0;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "%s/%u/devices", SYSFS_IOMMU_GROUPS,
+		 group_id);
+	dir = opendir(path);
+	if (!dir)
+		return errno == ENOENT ? 0 : -errno;
+
+	while (!ret) {
+		errno = 0;
+		entry = readdir(dir);
+		if (!entry) {
+			if (errno)
+				ret = -errno;
+			break;
+		}
+
+		if (pci_string_to_addr(entry->d_name, &addr) < 0)
+			continue;
+
+		string_buffer_clear(buf);
+		string_buffer_append(buf, SYSFS_PCI_DEVICES "/");
+		string_buffer_append(buf, entry->d_name);
+
+		ret = !(buf->status & STRING_BUFFER_OVERFLOW) &&
+		      access((const char *)buf->data, F_OK) == 0;
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/*
+ * Narrows the group range of @opts to the first opts->limit groups with a
+ * PCI device, for the backends that can only skip devices by their group.
+ * The range is kept when it has no more groups than the limit.
+ */
+int iommu_group_ids_limit(struct iommu_read_options *opts)
+{
+	unsigned int *ids, found = 0, last = 0;
+	int i, nr, ret = 0;
+
+	nr = iommu_group_ids_read(opts, &ids);
+	if (nr < 0)
+		return nr;
+
+	for (i = 0; i < nr && found < opts->limit; i++) {
+		ret = iommu_group_has_pci_device(ids[i]);
+		if (ret < 0)
+			break;
+
+		if (ret) {
+			last = ids[i];
+			found++;
+		}
+	}
+
+	if (ret >= 0 && found == opts->limit) {
+		if (!(opts->flags & IOMMU_READ_GROUPS))
+			opts->first_group = 0;
+		opts->last_group = last;
+		opts->flags |= IOMMU_READ_GROUPS;
+	}
+
+	free(ids);
+	return ret < 0 ? ret : 0;
+}
+
+/* Clears the attributes in @flags, which were read only for the fingerprint. */
+static void iommu_groups_drop(struct iommu_groups *list, unsigned int flags)
+{
+	struct iommu_group *group;
+	struct pci_device *dev;
+	unsigned int i, j;
+
+	for (i = 0; i < list->nr_groups; i++) {
+		group = &list->groups[i];
+
+		for (j = 0; j < group->nr_devices; j++) {
+			dev = &group->devices[j];
+
+			if (flags & IOMMU_READ_LOCALITY)
+				dev->locality.flags = 0;
+			if (flags & IOMMU_READ_VFIO)
+				dev->binding.flags = 0;
+			if (flags & IOMMU_READ_ACS)
+				dev->acs.flags = 0;
+		}
+
+		if (flags & IOMMU_READ_VFIO)
+			group->vfio = IOMMU_VFIO_UNKNOWN;
+
+		if (flags & IOMMU_READ_REGIONS) {
+			free(group->regions);
+			group->regions = NULL;
+			group->nr_regions = 0;
+			group->has_regions = false;
+		}
+
+		if (flags & IOMMU_READ_ACS) {
+			free(group->upstream);
+			group->upstream = NULL;
+			group->nr_upstream = 0;
+			group->has_upstream = false;
+		}
+	}
+}
+
+/*
+ * Group ranges and limits are pushed down into the backend, so that the
+ * groups outside them are never read. The NUMA filter drops groups only
+ * after reading, so with it the limit is applied after sorting. Groups are
+ * sorted and limited before the VFIO state, regions and ACS are read.
+ */
+bool iommu_groups_read(const struct iommu_backend *backend,
+		       const struct iommu_read_options *opts,
+		       struct iommu_groups *list)
+{
+	struct iommu_read_options read_opts = *opts;
+	unsigned int flags = opts->flags;
+	bool ret;
+
+	if (!backend->available())
+		return false;
+
+	/* The fingerprint does not depend on the attributes requested. */
+	if (flags & IOMMU_READ_FINGERPRINT)
+		flags |= IOMMU_READ_ATTRIBUTES;
+	read_opts.flags = flags;
+
+	if (read_opts.flags & IOMMU_READ_NUMA_FILTER)
+		read_opts.flags &= ~IOMMU_READ_LIMIT;
+
+	if ((read_opts.flags & (IOMMU_READ_GROUPS | IOMMU_READ_LIMIT)) &&
+	    backend->read_groups) {
+		ret = backend->read_groups(&read_opts, list);
+	} else {
+		/*
+		 * The limit becomes a group range. If the group directories
+		 * cannot be listed, every group is read and the limit is
+		 * applied only after sorting.
+		 */
+		if (read_opts.flags & IOMMU_READ_LIMIT) {
+			iommu_group_ids_limit(&read_opts);
+			read_opts.flags &= ~IOMMU_READ_LIMIT;
+		}
+
+		ret = backend->read(&read_opts, list);
+	}
+
+	if (!ret)
+		return false;
+
+	/* Only the filters applied by the read leave groups unread. */
+	iommu_groups_link_sriov(&read_opts, list);
+
+	if (opts->flags & IOMMU_READ_NUMA_FILTER)
+		iommu_groups_filter_numa(list, opts->numa_node);
+
+	iommu_groups_sort(list->groups, list->nr_groups);
+
+	if (opts->flags & IOMMU_READ_LIMIT)
+		iommu_groups_truncate(list, opts->limit);
+
+	if (flags & IOMMU_READ_VFIO)
+		iommu_groups_vfio_state(list->groups, list->nr_groups);
+
+	if (flags & IOMMU_READ_REGIONS)
+		iommu_groups_read_regions(list->groups, list->nr_groups);
+
+	if ((flags & IOMMU_READ_ACS) &&
+	    iommu_groups_read_acs(list->groups, list->nr_groups) < 0)
+		return false;
+
+	if (flags & IOMMU_READ_FINGERPRINT) {
+		list->fingerprint = iommu_groups_fingerprint(list->groups,
+							     list->nr_groups);
+		iommu_groups_drop(list, flags & ~opts->flags);
+	}
+
+	return true;
+}
@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "output.h"
+#include "pci.h"
+
+/* RFC 8949 major types */
+enum cbor_major {
+	CBOR_UINT = 0,
+	CBOR_NINT = 1,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+	CBOR_SIMPLE = 7,
+};
+
+#define CBOR_NULL 22
+
+static void cbor_head(struct output *out, enum cbor_major major,
+		      uint64_t value)
+{
+	uint8_t head[9];
+	size_t len;
+
+	head[0] = major << 5;
+
+	if (value < 24) {
+		head[0] |= value;
+		len = 1;
+	} else if (value <= 0xff) {
+		head[0] |= 24;
+		head[1] = value;
+		len = 2;
+	} else if (value <= 0xffff) {
+		head[0] |= 25;
+		head[1] = value >> 8;
+		head[2] = value;
+		len = 3;
+	} else if (value <= 0xffffffff) {
+		head[0] |= 26;
+		head[1] = value >> 24;
+		head[2] = value >> 16;
+		head[3] = value >> 8;
+		head[4] = value;
+		len = 5;
+	} else {
+		head[0] |= 27;
+		for (len = 1; len < 9; len++)
+			head[len] = value >> (64 - len * 8);
+	}
+
+	output_write(out, head, len);
+}
+
+static void cbor_text(struct output *out, const char *str)
+{
+	size_t len = strlen(str);
+
+	cbor_head(out, CBOR_TEXT, len);
+	output_write(out, str, len);
+}
+
+/*
+ * Sysfs properties are hex strings such as "0x8086". They are encoded as
+ * integers, and only a malformed value falls back to a text string.
+ */
+static void cbor_property(struct output *out, const char *key,
+			  const char *prop)
+{
+	uint32_t value;
+
+	cbor_text(out, key);
+
+	if (pci_property_to_u32(prop, &value) == 0)
+		cbor_head(out, CBOR_UINT, value);
+	else
+		cbor_text(out, prop);
+}
+
+static void cbor_int(struct output *out, int value)
+{
+	if (value < 0)
+		cbor_head(out, CBOR_NINT, -(value + 1));
+	else
+		cbor_head(out, CBOR_UINT, value);
+}
+
+static unsigned int cbor_locality_fields(struct pci_locality *loc)
+{
+	unsigned int nr_fields = 0;
+
+	if (loc->flags & PCI_LOCALITY_NUMA)
+		nr_fields++;
+	if (loc->flags & PCI_LOCALITY_CPULIST)
+		nr_fields++;
+	if (loc->flags & PCI_LOCALITY_LINK)
+		nr_fields += 2;
+
+	return nr_fields;
+}
+
+static void cbor_locality(struct output *out, struct pci_locality *loc)
+{
+	char speed[PCI_LINK_SPEED_STRING_SIZE];
+	char *p;
+
+	if (loc->flags & PCI_LOCALITY_NUMA) {
+		cbor_text(out, "numa_node");
+		cbor_int(out, loc->numa_node);
+	}
+
+	if (loc->flags & PCI_LOCALITY_CPULIST) {
+		cbor_text(out, "local_cpulist");
+		cbor_text(out, loc->cpulist);
+	}
+
+	if (loc->flags & PCI_LOCALITY_LINK) {
+		p = pci_encode_link_speed(speed, loc->link_speed);
+		memcpy(p, " GT/s", sizeof(" GT/s"));
+		cbor_text(out, "link_speed");
+		cbor_text(out, speed);
+		cbor_text(out, "link_width");
+		cbor_head(out, CBOR_UINT, loc->link_width);
+	}
+}
+
+static unsigned int cbor_binding_fields(struct pci_binding *binding)
+{
+	return !!(binding->flags & PCI_BINDING_DRIVER) +
+	       !!(binding->flags & PCI_BINDING_HEADER);
+}
+
+static void cbor_binding(struct output *out, struct pci_binding *binding)
+{
+	if (binding->flags & PCI_BINDING_DRIVER) {
+		cbor_text(out, "driver");
+		if (binding->driver[0])
+			cbor_text(out, binding->driver);
+		else
+			cbor_head(out, CBOR_SIMPLE, CBOR_NULL);
+	}
+
+	if (binding->flags & PCI_BINDING_HEADER) {
+		cbor_text(out, "header_type");
+		cbor_head(out, CBOR_UINT, binding->header_type);
+	}
+}
+
+static unsigned int cbor_sriov_fields(struct pci_sriov *sriov)
+{
+	return !!(sriov->flags & PCI_SRIOV_PHYSFN) +
+	       !!(sriov->flags & PCI_SRIOV_VIRTFN);
+}
+
+static void cbor_sriov(struct output *out, struct pci_sriov *sriov)
+{
+	if (sriov->flags & PCI_SRIOV_PHYSFN) {
+		cbor_text(out, "nr_virtfn");
+		cbor_head(out, CBOR_UINT, sriov->nr_virtfn);
+	}
+
+	if (sriov->flags & PCI_SRIOV_VIRTFN) {
+		cbor_text(out, "physfn");
+		cbor_head(out, CBOR_UINT, sriov->physfn);
+	}
+}
+
+static unsigned int cbor_acs_fields(const struct pci_acs *acs)
+{
+	return !!(acs->flags & PCI_ACS_READ);
+}
+
+static void cbor_acs(struct output *out, const struct pci_acs *acs)
+{
+	if (!(acs->flags & PCI_ACS_READ))
+		return;
+
+	cbor_text(out, "acs");
+	if (!(acs->flags & PCI_ACS_PRESENT)) {
+		cbor_head(out, CBOR_SIMPLE, CBOR_NULL);
+		return;
+	}
+
+	cbor_head(out, CBOR_MAP, 2);
+	cbor_text(out, "cap");
+	cbor_head(out, CBOR_UINT, acs->cap);
+	cbor_text(out, "ctrl");
+	cbor_head(out, CBOR_UINT, acs->ctrl);
+}
+
+static void cbor_upstream(struct output *out, const struct iommu_group *group)
+{
+	const struct iommu_bridge *bridge;
+	unsigned int i;
+
+	cbor_text(out, "upstream");
+	cbor_head(out, CBOR_ARRAY, group->nr_upstream);
+	for (i = 0; i < group->nr_upstream; i++) {
+		bridge = &group->upstream[i];
+		cbor_head(out, CBOR_MAP, 1 + cbor_acs_fields(&bridge->acs));
+		cbor_text(out, "address");
+		cbor_head(out, CBOR_UINT, bridge->addr);
+		cbor_acs(out, &bridge->acs);
+	}
+}
+
+static void iommu_cbor_begin(struct output *out,
+			     const struct iommu_groups *list)
+{
+	cbor_head(out, CBOR_MAP, 2);
+	cbor_text(out, "fingerprint");
+	cbor_head(out, CBOR_UINT, list->fingerprint);
+	cbor_text(out, "iommu_groups");
+	cbor_head(out, CBOR_ARRAY, list->nr_groups);
+}
+
+static void iommu_cbor_group_begin(struct output *out,
+				   struct iommu_group *group,
+				   unsigned int index)
+{
+	bool has_vfio = group->vfio != IOMMU_VFIO_UNKNOWN;
+	const struct iommu_region *region;
+	unsigned int i;
+
+	cbor_head(out, CBOR_MAP,
+		  2 + has_vfio + group->has_regions + group->has_upstream);
+	cbor_text(out, "id");
+	cbor_head(out, CBOR_UINT, group->group_id);
+	if (has_vfio) {
+		cbor_text(out, "vfio");
+		cbor_text(out, iommu_vfio_state_name(group->vfio));
+	}
+	if (group->has_regions) {
+		cbor_text(out, "reserved_regions");
+		cbor_head(out, CBOR_ARRAY, group->nr_regions);
+		for (i = 0; i < group->nr_regions; i++) {
+			region = &group->regions[i];
+			cbor_head(out, CBOR_MAP, 3);
+			cbor_text(out, "start");
+			cbor_head(out, CBOR_UINT, region->start);
+			cbor_text(out, "end");
+			cbor_head(out, CBOR_UINT, region->end);
+			cbor_text(out, "type");
+			cbor_text(out, iommu_region_type_name(region->type));
+		}
+	}
+	if (group->has_upstream)
+		cbor_upstream(out, group);
+	cbor_text(out, "devices");
+	cbor_head(out, CBOR_ARRAY, group->nr_devices);
+}
+
+static void iommu_cbor_device(struct output *out, struct iommu_group *group,
+			      struct pci_device *dev, unsigned int index)
+{
+	unsigned int nr_fields = 1;
+
+	if (dev->valid)
+		nr_fields += (dev->has_revision ? 4 : 3) +
+			     cbor_locality_fields(&dev->locality) +
+			     cbor_binding_fields(&dev->binding) +
+			     cbor_sriov_fields(&dev->sriov) +
+			     cbor_acs_fields(&dev->acs);
+
+	cbor_head(out, CBOR_MAP, nr_fields);
+	cbor_text(out, "address");
+	cbor_head(out, CBOR_UINT, dev->addr);
+
+	if (!dev->valid)
+		return;
+
+	cbor_property(out, "class", dev->class);
+	cbor_property(out, "vendor", dev->vendor);
+	cbor_property(out, "device", dev->device);
+	if (dev->has_revision)
+		cbor_property(out, "revision", dev->revision);
+
+	cbor_locality(out, &dev->locality);
+	cbor_binding(out, &dev->binding);
+	cbor_sriov(out, &dev->sriov);
+	cbor_acs(out, &dev->acs);
+}
+
+const struct iommu_emitter iommu_cbor_emitter = {
+	.name = "cbor",
+	.fingerprint = true,
+	.begin = iommu_cbor_begin,
+	.group_begin = iommu_cbor_group_begin,
+	.device = iommu_cbor_device,
+};
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "pci.h"
+#include "string-buffer.h"
+#include "sysfs-file.h"
+
+#define SYSFS_PCI_DEVICES "/sys/bus/pci/devices"
+
+static int iommu_parse_long(const char *str, long *value)
+{
+	char *endptr;
+
+	errno = 0;
+	*value = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0')
+		return -EINVAL;
+
+	return 0;
+}
+
+static void iommu_read_locality(const char *dev_path, struct pci_device *dev)
+{
+	struct pci_locality *loc = &dev->locality;
+	char buf[32];
+	long value;
+	ssize_t len;
+
+	loc->flags = 0;
+
+	if (sysfs_read_attr(dev_path, "numa_node", buf, sizeof(buf)) > 0 &&
+	    iommu_parse_long(buf, &value) == 0 && value >= INT16_MIN &&
+	    value <= INT16_MAX) {
+		loc->numa_node = value;
+		loc->flags |= PCI_LOCALITY_NUMA;
+	}
+
+	/* A list that fills the whole buffer might be truncated. */
+	len = sysfs_read_attr(dev_path, "local_cpulist", loc->cpulist,
+			      sizeof(loc->cpulist));
+	if (len > 0 && (size_t)len < sizeof(loc->cpulist) - 1)
+		loc->flags |= PCI_LOCALITY_CPULIST;
+
+	if (sysfs_read_attr(dev_path, "current_link_speed", buf,
+			    sizeof(buf)) <= 0 ||
+	    pci_parse_link_speed(buf, &loc->link_speed) < 0)
+		return;
+
+	if (sysfs_read_attr(dev_path, "current_link_width", buf,
+			    sizeof(buf)) <= 0 ||
+	    iommu_parse_long(buf, &value) < 0 || value <= 0 || value > 32)
+		return;
+
+	loc->link_width = value;
+	loc->flags |= PCI_LOCALITY_LINK;
+}
+
+static int iommu_physfn_read(const char *dev_path, struct iommu_physfn *pf)
+{
+	STRING_BUFFER(path, PATH_MAX);
+
+	string_buffer_append(path, dev_path);
+	string_buffer_append(path, "/physfn");
+	if (path->status & STRING_BUFFER_OVERFLOW)
+		return -ENAMETOOLONG;
+
+	pf->nr_virtfn = 0;
+
+	if (sysfs_read_attr((const char *)path->data, "vendor", pf->vendor,
+			    sizeof(pf->vendor)) < 0 ||
+	    sysfs_read_attr((const char *)path->data, "sriov_vf_device",
+			    pf->device, sizeof(pf->device)) < 0 ||
+	    sysfs_read_attr((const char *)path->data, "class", pf->class,
+			    sizeof(pf->class)) < 0)
+		return -ENOENT;
+
+	pf->has_revision = sysfs_read_attr((const char *)path->data,
+					   "revision", pf->revision,
+					   sizeof(pf->revision)) >= 0;
+	return 0;
+}
+
+/*
+ * Fills the core attributes of a virtual function from its physical
+ * function, which are read only once per physical function. Returns
+ * -ENOENT when the device is not a virtual function, and any error means
+ * that the attributes must be read from the device itself.
+ */
+int iommu_read_virtfn(struct iommu_groups *list, const char *dev_path,
+		      struct pci_device *dev)
+{
+	char name[PCI_ADDR_STRING_SIZE];
+	struct iommu_physfn *pf;
+	struct iommu_physfn read;
+	uint32_t addr;
+	ssize_t len;
+	int ret;
+
+	dev->sriov.flags = 0;
+
+	len = sysfs_read_link_name(dev_path, "physfn", name, sizeof(name));
+	if (len < 0)
+		return len;
+
+	ret = pci_string_to_addr(name, &addr);
+	if (ret < 0)
+		return ret;
+
+	pf = iommu_groups_find_physfn(list, addr);
+	if (!pf) {
+		ret = iommu_physfn_read(dev_path, &read);
+		if (ret < 0)
+			return ret;
+
+		/* Without memory, the virtual functions are not counted. */
+		pf = iommu_groups_add_physfn(list, addr, &read);
+		if (!pf) {
+			list->physfn_missed = true;
+			pf = &read;
+		}
+	}
+
+	memcpy(dev->class, pf->class, sizeof(dev->class));
+	memcpy(dev->vendor, pf->vendor, sizeof(dev->vendor));
+	memcpy(dev->device, pf->device, sizeof(dev->device));
+	memcpy(dev->revision, pf->revision, sizeof(dev->revision));
+	dev->has_revision = pf->has_revision;
+
+	dev->sriov.flags = PCI_SRIOV_VIRTFN;
+	dev->sriov.physfn = addr;
+	pf->nr_virtfn++;
+
+	return 0;
+}
+
+/* Reads the number of enabled virtual functions of a device. */
+static unsigned int iommu_read_numvfs(uint32_t addr)
+{
+	char path[sizeof(SYSFS_PCI_DEVICES) + PCI_ADDR_STRING_SIZE];
+	char buf[16];
+	long value;
+
+	memcpy(path, SYSFS_PCI_DEVICES "/", sizeof(SYSFS_PCI_DEVICES));
+	pci_addr_to_string(addr, path + sizeof(SYSFS_PCI_DEVICES),
+			   PCI_ADDR_STRING_SIZE);
+
+	if (sysfs_read_attr(path, "sriov_numvfs", buf, sizeof(buf)) <= 0 ||
+	    iommu_parse_long(buf, &value) < 0 || value <= 0 ||
+	    value > UINT16_MAX)
+		return 0;
+
+	return value;
+}
+
+/*
+ * Marks the physical functions seen by iommu_read_virtfn(), and releases
+ * them. When only some groups were read, the virtual functions can be in
+ * the others, and the number of virtual functions is read from
+ * sriov_numvfs instead, as it is when a physical function was missed.
+ */
+void iommu_groups_link_sriov(const struct iommu_read_options *opts,
+			     struct iommu_groups *list)
+{
+	bool partial = (opts->flags & (IOMMU_READ_GROUPS | IOMMU_READ_LIMIT)) ||
+		       list->physfn_missed;
+	struct iommu_physfn *pf;
+	struct pci_device *dev;
+	unsigned int i, j, nr_virtfn;
+
+	if (!list->physfns.nr_entries && !partial)
+		return;
+
+	for (i = 0; i < list->nr_groups; i++) {
+		for (j = 0; j < list->groups[i].nr_devices; j++) {
+			dev = &list->groups[i].devices[j];
+			if (dev->sriov.flags & PCI_SRIOV_VIRTFN)
+				continue;
+
+			if (partial) {
+				nr_virtfn = iommu_read_numvfs(dev->addr);
+			} else {
+				pf = iommu_groups_find_physfn(list,
+							      dev->addr);
+				nr_virtfn = pf ? pf->nr_virtfn : 0;
+			}
+
+			if (!nr_virtfn)
+				continue;
+
+			dev->sriov.flags = PCI_SRIOV_PHYSFN;
+			dev->sriov.nr_virtfn = nr_virtfn;
+		}
+	}
+
+	iommu_groups_release_physfns(list);
+}
+
+static void iommu_read_binding(const char *dev_path, struct pci_device *dev)
+{
+	struct pci_binding *binding = &dev->binding;
+	uint8_t config[PCI_HEADER_TYPE + 1];
+	ssize_t len;
+
+	binding->flags = 0;
+
+	len = sysfs_read_link_name(dev_path, "driver", binding->driver,
+				   sizeof(binding->driver));
+	if (len == -ENOENT)
+		binding->driver[0] = '\0';
+	if (len >= 0 || len == -ENOENT)
+		binding->flags |= PCI_BINDING_DRIVER;
+
+	if (sysfs_read_binary(dev_path, "config", config, sizeof(config)) ==
+	    sizeof(config)) {
+		binding->header_type = config[PCI_HEADER_TYPE];
+		binding->flags |= PCI_BINDING_HEADER;
+	}
+}
+
+/*
+ * Reads the optional attributes selected by @opts for a device whose
+ * core attributes have been read from @dev_path.
+ */
+void iommu_read_device_extras(const struct iommu_read_options *opts,
+			      const char *dev_path, struct pci_device *dev)
+{
+	if (opts->flags & IOMMU_READ_LOCALITY)
+		iommu_read_locality(dev_path, dev);
+	else
+		dev->locality.flags = 0;
+
+	if (opts->flags & IOMMU_READ_VFIO)
+		iommu_read_binding(dev_path, dev);
+	else
+		dev->binding.flags = 0;
+}
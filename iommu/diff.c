@@ -0,0 +1,342 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap-sort.h"
+#include "iommu.h"
+#include "output.h"
+#include "pci.h"
+#include "vector.h"
+
+/* A device that is in only one of the snapshots within a matching group. */
+struct iommu_diff_entry {
+	unsigned int group_id;
+	const struct pci_device *dev;
+};
+
+static inline bool iommu_diff_entry_less(const struct iommu_diff_entry *a,
+					 const struct iommu_diff_entry *b)
+{
+	return a->dev->addr < b->dev->addr;
+}
+
+DEFINE_VECTOR(iommu_diff_entries, struct iommu_diff_entry)
+DEFINE_HEAP_SORT(iommu_diff_entries_sort, struct iommu_diff_entry,
+		 iommu_diff_entry_less)
+
+struct iommu_diff {
+	struct output *out;
+	enum iommu_record_style style;
+	unsigned int nr_changes;
+	struct iommu_diff_entries removed;
+	struct iommu_diff_entries added;
+	bool oom;
+};
+
+static void iommu_diff_push(struct iommu_diff *diff,
+			    struct iommu_diff_entries *list,
+			    unsigned int group_id, const struct pci_device *dev)
+{
+	struct iommu_diff_entry *entry;
+
+	entry = iommu_diff_entries_push(list);
+	if (!entry) {
+		diff->oom = true;
+		return;
+	}
+
+	entry->group_id = group_id;
+	entry->dev = dev;
+}
+
+static void iommu_diff_record_begin(struct iommu_diff *diff,
+				    const char *change, uint32_t addr,
+				    unsigned int group_id)
+{
+	struct output *out = diff->out;
+
+	if (diff->style == IOMMU_RECORD_PLAIN) {
+		output_str(out, change);
+		output_char(out, ' ');
+		output_pci_addr(out, addr);
+		output_str(out, " group ");
+		output_dec(out, group_id, 0);
+	} else {
+		if (diff->style == IOMMU_RECORD_JSON && diff->nr_changes > 0)
+			output_char(out, ',');
+
+		output_str(out, "{\"change\":\"");
+		output_str(out, change);
+		output_str(out, "\",\"address\":\"");
+		output_pci_addr(out, addr);
+		output_str(out, "\",\"group\":");
+		output_dec(out, group_id, 0);
+	}
+
+	diff->nr_changes++;
+}
+
+static void iommu_diff_record_end(struct iommu_diff *diff)
+{
+	if (diff->style == IOMMU_RECORD_PLAIN)
+		output_char(diff->out, '\n');
+	else if (diff->style == IOMMU_RECORD_JSON)
+		output_char(diff->out, '}');
+	else
+		output_str(diff->out, "}\n");
+}
+
+static void iommu_diff_value(struct iommu_diff *diff, const char *key,
+			     const char *value)
+{
+	struct output *out = diff->out;
+
+	if (diff->style == IOMMU_RECORD_PLAIN) {
+		output_char(out, ' ');
+		output_str(out, key);
+		output_char(out, ' ');
+		output_str(out, value ? value : "-");
+		return;
+	}
+
+	output_str(out, ",\"");
+	output_str(out, key);
+	output_str(out, "\":");
+	if (value)
+		iommu_json_append_string(out, value);
+	else
+		output_str(out, "null");
+}
+
+static void iommu_diff_attr(struct iommu_diff *diff, unsigned int group_id,
+			    uint32_t addr, const char *attr,
+			    const char *old_value, const char *new_value)
+{
+	if (!old_value && !new_value)
+		return;
+
+	if (old_value && new_value && strcmp(old_value, new_value) == 0)
+		return;
+
+	iommu_diff_record_begin(diff, "changed", addr, group_id);
+	iommu_diff_value(diff, "attribute", attr);
+	iommu_diff_value(diff, "old", old_value);
+	iommu_diff_value(diff, "new", new_value);
+	iommu_diff_record_end(diff);
+}
+
+static const char *iommu_diff_prop(const struct pci_device *dev,
+				   const char *prop)
+{
+	return dev->valid ? prop + 2 : NULL;
+}
+
+static const char *iommu_diff_driver(const struct pci_device *dev)
+{
+	if (!(dev->binding.flags & PCI_BINDING_DRIVER))
+		return NULL;
+
+	return dev->binding.driver[0] ? dev->binding.driver : "none";
+}
+
+static const char *iommu_diff_numa(const struct pci_device *dev, char *buf)
+{
+	char *p = buf;
+	int node = dev->locality.numa_node;
+
+	if (!(dev->locality.flags & PCI_LOCALITY_NUMA))
+		return NULL;
+
+	if (node < 0) {
+		*p++ = '-';
+		node = -node;
+	}
+
+	*output_encode_dec(p, node, 0) = '\0';
+	return buf;
+}
+
+/*
+ * Compares the attributes that both snapshots have. Optional attributes
+ * are compared only when both snapshots were taken with them.
+ */
+static void iommu_diff_device(struct iommu_diff *diff, unsigned int group_id,
+			      const struct pci_device *old,
+			      const struct pci_device *new)
+{
+	char old_numa[16], new_numa[16];
+	uint32_t addr = new->addr;
+
+	iommu_diff_attr(diff, group_id, addr, "class",
+			iommu_diff_prop(old, old->class),
+			iommu_diff_prop(new, new->class));
+	iommu_diff_attr(diff, group_id, addr, "vendor",
+			iommu_diff_prop(old, old->vendor),
+			iommu_diff_prop(new, new->vendor));
+	iommu_diff_attr(diff, group_id, addr, "device",
+			iommu_diff_prop(old, old->device),
+			iommu_diff_prop(new, new->device));
+	iommu_diff_attr(diff, group_id, addr, "revision",
+			old->has_revision ?
+				iommu_diff_prop(old, old->revision) : NULL,
+			new->has_revision ?
+				iommu_diff_prop(new, new->revision) : NULL);
+
+	if ((old->binding.flags & new->binding.flags) & PCI_BINDING_DRIVER)
+		iommu_diff_attr(diff, group_id, addr, "driver",
+				iommu_diff_driver(old),
+				iommu_diff_driver(new));
+
+	if ((old->locality.flags & new->locality.flags) & PCI_LOCALITY_NUMA)
+		iommu_diff_attr(diff, group_id, addr, "numa_node",
+				iommu_diff_numa(old, old_numa),
+				iommu_diff_numa(new, new_numa));
+}
+
+static void iommu_diff_group(struct iommu_diff *diff,
+			     const struct iommu_group *old,
+			     const struct iommu_group *new)
+{
+	unsigned int i = 0, j = 0;
+	const struct pci_device *old_dev, *new_dev;
+
+	while (i < old->nr_devices || j < new->nr_devices) {
+		old_dev = i < old->nr_devices ? &old->devices[i] : NULL;
+		new_dev = j < new->nr_devices ? &new->devices[j] : NULL;
+
+		if (old_dev && (!new_dev || old_dev->addr < new_dev->addr)) {
+			iommu_diff_push(diff, &diff->removed, old->group_id,
+					old_dev);
+			i++;
+		} else if (new_dev &&
+			   (!old_dev || new_dev->addr < old_dev->addr)) {
+			iommu_diff_push(diff, &diff->added, new->group_id,
+					new_dev);
+			j++;
+		} else {
+			iommu_diff_device(diff, new->group_id, old_dev,
+					  new_dev);
+			i++;
+			j++;
+		}
+	}
+}
+
+static void iommu_diff_group_only(struct iommu_diff *diff,
+				  struct iommu_diff_entries *list,
+				  const struct iommu_group *group)
+{
+	unsigned int i;
+
+	for (i = 0; i < group->nr_devices; i++)
+		iommu_diff_push(diff, list, group->group_id,
+				&group->devices[i]);
+}
+
+/*
+ * Pairs the devices that disappeared from one group and appeared in
+ * another by their address.
+ */
+static void iommu_diff_moves(struct iommu_diff *diff)
+{
+	struct iommu_diff_entries *removed = &diff->removed;
+	struct iommu_diff_entries *added = &diff->added;
+	const struct iommu_diff_entry *old, *new;
+	unsigned int i = 0, j = 0;
+
+	iommu_diff_entries_sort(removed->items, removed->nr_items);
+	iommu_diff_entries_sort(added->items, added->nr_items);
+
+	while (i < removed->nr_items || j < added->nr_items) {
+		old = i < removed->nr_items ? &removed->items[i] : NULL;
+		new = j < added->nr_items ? &added->items[j] : NULL;
+
+		if (old && (!new || old->dev->addr < new->dev->addr)) {
+			iommu_diff_record_begin(diff, "removed", old->dev->addr,
+						old->group_id);
+			iommu_diff_record_end(diff);
+			i++;
+		} else if (new && (!old || new->dev->addr < old->dev->addr)) {
+			iommu_diff_record_begin(diff, "added", new->dev->addr,
+						new->group_id);
+			iommu_diff_record_end(diff);
+			j++;
+		} else {
+			iommu_diff_record_begin(diff, "moved", new->dev->addr,
+						new->group_id);
+			if (diff->style == IOMMU_RECORD_PLAIN)
+				output_str(diff->out, " old_group ");
+			else
+				output_str(diff->out, ",\"old_group\":");
+			output_dec(diff->out, old->group_id, 0);
+			iommu_diff_record_end(diff);
+
+			iommu_diff_device(diff, new->group_id, old->dev,
+					  new->dev);
+			i++;
+			j++;
+		}
+	}
+}
+
+/*
+ * Compares two sorted snapshots with a merge walk over the groups and the
+ * devices within them. Returns the number of changes or a negative error.
+ */
+int iommu_diff(struct output *out, enum iommu_record_style style,
+	       const struct iommu_groups *old, const struct iommu_groups *new)
+{
+	struct iommu_diff diff = { .out = out, .style = style };
+	const struct iommu_group *old_group, *new_group;
+	unsigned int i = 0, j = 0;
+	int ret;
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "{\"changes\":[");
+
+	while (i < old->nr_groups || j < new->nr_groups) {
+		old_group = i < old->nr_groups ? &old->groups[i] : NULL;
+		new_group = j < new->nr_groups ? &new->groups[j] : NULL;
+
+		if (old_group && (!new_group ||
+				  old_group->group_id < new_group->group_id)) {
+			iommu_diff_group_only(&diff, &diff.removed, old_group);
+			i++;
+		} else if (new_group &&
+			   (!old_group ||
+			    new_group->group_id < old_group->group_id)) {
+			iommu_diff_group_only(&diff, &diff.added, new_group);
+			j++;
+		} else {
+			iommu_diff_group(&diff, old_group, new_group);
+			i++;
+			j++;
+		}
+	}
+
+	if (!diff.oom)
+		iommu_diff_moves(&diff);
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "]}\n");
+
+	iommu_diff_entries_free(&diff.removed);
+	iommu_diff_entries_free(&diff.added);
+
+	if (diff.oom)
+		return -ENOMEM;
+
+	ret = out->error;
+	if (ret)
+		return ret;
+
+	return diff.nr_changes;
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "output.h"
+
+static const struct iommu_emitter *iommu_emitters[] = {
+	&iommu_plain_emitter,
+	&iommu_json_emitter,
+	&iommu_ndjson_emitter,
+	&iommu_cbor_emitter,
+};
+
+const struct iommu_emitter *iommu_emitter_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(iommu_emitters) / sizeof(iommu_emitters[0]); i++)
+		if (strcmp(iommu_emitters[i]->name, name) == 0)
+			return iommu_emitters[i];
+
+	return NULL;
+}
+
+/* A contiguous range of groups formatted by one thread. */
+struct iommu_emit_job {
+	const struct iommu_emitter *emitter;
+	struct iommu_group *groups;
+	unsigned int first;
+	unsigned int last;
+	struct output *out;
+	pthread_t thread;
+	bool started;
+};
+
+static void iommu_emit_groups(const struct iommu_emitter *emitter,
+			      struct output *out, struct iommu_group *groups,
+			      unsigned int first, unsigned int last)
+{
+	struct iommu_group *group;
+	unsigned int i, j;
+
+	for (i = first; i < last; i++) {
+		group = &groups[i];
+
+		if (emitter->group_begin)
+			emitter->group_begin(out, group, i);
+
+		for (j = 0; j < group->nr_devices; j++)
+			emitter->device(out, group, &group->devices[j], j);
+
+		if (emitter->group_end)
+			emitter->group_end(out, group, i);
+	}
+}
+
+int iommu_emit(const struct iommu_emitter *emitter, struct output *out,
+	       const struct iommu_groups *list)
+{
+	if (emitter->begin)
+		emitter->begin(out, list);
+
+	iommu_emit_groups(emitter, out, list->groups, 0, list->nr_groups);
+
+	if (emitter->end)
+		emitter->end(out, list);
+
+	return out->error;
+}
+
+static void *iommu_emit_worker(void *arg)
+{
+	struct iommu_emit_job *job = arg;
+
+	iommu_emit_groups(job->emitter, job->out, job->groups, job->first,
+			  job->last);
+	return NULL;
+}
+
+/*
+ * Splits the groups into @nr_jobs contiguous ranges of about the same
+ * number of groups and devices.
+ */
+static void iommu_emit_split(struct iommu_emit_job *jobs, unsigned int nr_jobs,
+			     struct iommu_group *groups, unsigned int nr_groups)
+{
+	uint64_t total = 0, weight = 0;
+	unsigned int i, k = 0;
+
+	for (i = 0; i < nr_groups; i++)
+		total += 1 + groups[i].nr_devices;
+
+	jobs[0].first = 0;
+	for (i = 0; i < nr_groups; i++) {
+		weight += 1 + groups[i].nr_devices;
+		if (k + 1 < nr_jobs && weight * nr_jobs >= (k + 1) * total) {
+			jobs[k].last = i + 1;
+			jobs[++k].first = i + 1;
+		}
+	}
+
+	jobs[k].last = nr_groups;
+	while (++k < nr_jobs)
+		jobs[k].first = jobs[k].last = nr_groups;
+}
+
+/*
+ * Formats the groups on @nr_jobs threads, including the calling thread,
+ * each into its own dynamic buffer, and writes the buffers to @fd in order.
+ * The output is identical to iommu_emit(). A job whose thread cannot be
+ * created is run by the calling thread.
+ */
+int iommu_emit_parallel(const struct iommu_emitter *emitter, int fd,
+			const struct iommu_groups *list, unsigned int nr_jobs)
+{
+	struct iommu_group *groups = list->groups;
+	unsigned int nr_groups = list->nr_groups;
+	struct iommu_emit_job *jobs;
+	struct output *bufs;
+	unsigned int i;
+	int ret = 0;
+
+	if (nr_jobs > nr_groups)
+		nr_jobs = nr_groups;
+	if (nr_jobs == 0)
+		nr_jobs = 1;
+
+	/* The first and the last buffer hold begin() and end(). */
+	jobs = calloc(nr_jobs, sizeof(*jobs));
+	bufs = calloc(nr_jobs + 2, sizeof(*bufs));
+	if (!jobs || !bufs) {
+		free(jobs);
+		free(bufs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr_jobs + 2; i++)
+		output_init_dynamic(&bufs[i]);
+
+	iommu_emit_split(jobs, nr_jobs, groups, nr_groups);
+
+	for (i = 0; i < nr_jobs; i++) {
+		jobs[i].emitter = emitter;
+		jobs[i].groups = groups;
+		jobs[i].out = &bufs[i + 1];
+	}
+
+	for (i = 1; i < nr_jobs; i++)
+		jobs[i].started = pthread_create(&jobs[i].thread, NULL,
+						 iommu_emit_worker,
+						 &jobs[i]) == 0;
+
+	if (emitter->begin)
+		emitter->begin(&bufs[0], list);
+
+	for (i = 0; i < nr_jobs; i++)
+		if (!jobs[i].started)
+			iommu_emit_worker(&jobs[i]);
+
+	if (emitter->end)
+		emitter->end(&bufs[nr_jobs + 1], list);
+
+	for (i = 1; i < nr_jobs; i++)
+		if (jobs[i].started)
+			pthread_join(jobs[i].thread, NULL);
+
+	for (i = 0; i < nr_jobs + 2 && !ret; i++)
+		ret = bufs[i].error;
+
+	if (!ret)
+		ret = output_write_buffers(fd, bufs, nr_jobs + 2);
+
+	for (i = 0; i < nr_jobs + 2; i++)
+		output_release(&bufs[i]);
+
+	free(bufs);
+	free(jobs);
+	return ret;
+}
@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "pci.h"
+
+#define FNV1A_64_OFFSET 0xcbf29ce484222325ULL
+#define FNV1A_64_PRIME 0x00000100000001b3ULL
+
+/* Field tags, so that a missing field never hashes like a zero value. */
+enum fingerprint_tag {
+	FINGERPRINT_GROUP = 1,
+	FINGERPRINT_DEVICE,
+	FINGERPRINT_CLASS,
+	FINGERPRINT_VENDOR,
+	FINGERPRINT_DEVICE_ID,
+	FINGERPRINT_REVISION,
+	FINGERPRINT_NUMA_NODE,
+	FINGERPRINT_CPULIST,
+	FINGERPRINT_LINK,
+	FINGERPRINT_DRIVER,
+	FINGERPRINT_HEADER_TYPE,
+	FINGERPRINT_NR_VIRTFN,
+	FINGERPRINT_PHYSFN,
+	FINGERPRINT_REGIONS,
+	FINGERPRINT_REGION_START,
+	FINGERPRINT_REGION_END,
+	FINGERPRINT_REGION_TYPE,
+	FINGERPRINT_ACS,
+	FINGERPRINT_ACS_CAP,
+	FINGERPRINT_ACS_CTRL,
+	FINGERPRINT_UPSTREAM,
+	FINGERPRINT_BRIDGE,
+};
+
+static uint64_t fingerprint_byte(uint64_t hash, uint8_t byte)
+{
+	return (hash ^ byte) * FNV1A_64_PRIME;
+}
+
+/* Integers are hashed in little-endian order on every host. */
+static uint64_t fingerprint_u32(uint64_t hash, uint8_t tag, uint32_t value)
+{
+	hash = fingerprint_byte(hash, tag);
+	hash = fingerprint_byte(hash, value);
+	hash = fingerprint_byte(hash, value >> 8);
+	hash = fingerprint_byte(hash, value >> 16);
+	return fingerprint_byte(hash, value >> 24);
+}
+
+static uint64_t fingerprint_u64(uint64_t hash, uint8_t tag, uint64_t value)
+{
+	unsigned int i;
+
+	hash = fingerprint_byte(hash, tag);
+	for (i = 0; i < 8; i++)
+		hash = fingerprint_byte(hash, value >> (i * 8));
+
+	return hash;
+}
+
+static uint64_t fingerprint_str(uint64_t hash, uint8_t tag, const char *str)
+{
+	size_t len = strlen(str);
+
+	hash = fingerprint_u32(hash, tag, len);
+	while (*str)
+		hash = fingerprint_byte(hash, *str++);
+
+	return hash;
+}
+
+/* Malformed sysfs properties are hashed as strings. */
+static uint64_t fingerprint_property(uint64_t hash, uint8_t tag,
+				     const char *prop)
+{
+	uint32_t value;
+
+	if (pci_property_to_u32(prop, &value) == 0)
+		return fingerprint_u32(hash, tag, value);
+
+	return fingerprint_str(hash, tag | 0x80, prop);
+}
+
+/* Registers that were read, with or without the capability. */
+static uint64_t fingerprint_acs(uint64_t hash, const struct pci_acs *acs)
+{
+	if (!(acs->flags & PCI_ACS_READ))
+		return hash;
+
+	hash = fingerprint_u32(hash, FINGERPRINT_ACS,
+			       !!(acs->flags & PCI_ACS_PRESENT));
+	if (!(acs->flags & PCI_ACS_PRESENT))
+		return hash;
+
+	hash = fingerprint_u32(hash, FINGERPRINT_ACS_CAP, acs->cap);
+	return fingerprint_u32(hash, FINGERPRINT_ACS_CTRL, acs->ctrl);
+}
+
+static uint64_t fingerprint_device(uint64_t hash, const struct pci_device *dev)
+{
+	const struct pci_locality *loc = &dev->locality;
+	const struct pci_binding *binding = &dev->binding;
+	const struct pci_sriov *sriov = &dev->sriov;
+
+	hash = fingerprint_u32(hash, FINGERPRINT_DEVICE, dev->addr);
+	if (!dev->valid)
+		return hash;
+
+	hash = fingerprint_property(hash, FINGERPRINT_CLASS, dev->class);
+	hash = fingerprint_property(hash, FINGERPRINT_VENDOR, dev->vendor);
+	hash = fingerprint_property(hash, FINGERPRINT_DEVICE_ID, dev->device);
+	if (dev->has_revision)
+		hash = fingerprint_property(hash, FINGERPRINT_REVISION,
+					    dev->revision);
+
+	if (loc->flags & PCI_LOCALITY_NUMA)
+		hash = fingerprint_u32(hash, FINGERPRINT_NUMA_NODE,
+				       (uint32_t)loc->numa_node);
+	if (loc->flags & PCI_LOCALITY_CPULIST)
+		hash = fingerprint_str(hash, FINGERPRINT_CPULIST,
+				       loc->cpulist);
+	if (loc->flags & PCI_LOCALITY_LINK)
+		hash = fingerprint_u32(hash, FINGERPRINT_LINK,
+				       (uint32_t)loc->link_speed << 8 |
+					       loc->link_width);
+
+	if (binding->flags & PCI_BINDING_DRIVER)
+		hash = fingerprint_str(hash, FINGERPRINT_DRIVER,
+				       binding->driver);
+	if (binding->flags & PCI_BINDING_HEADER)
+		hash = fingerprint_u32(hash, FINGERPRINT_HEADER_TYPE,
+				       binding->header_type);
+
+	if (sriov->flags & PCI_SRIOV_PHYSFN)
+		hash = fingerprint_u32(hash, FINGERPRINT_NR_VIRTFN,
+				       sriov->nr_virtfn);
+	if (sriov->flags & PCI_SRIOV_VIRTFN)
+		hash = fingerprint_u32(hash, FINGERPRINT_PHYSFN,
+				       sriov->physfn);
+
+	return fingerprint_acs(hash, &dev->acs);
+}
+
+/* The regions are hashed in their sorted order. */
+static uint64_t fingerprint_regions(uint64_t hash,
+				    const struct iommu_group *group)
+{
+	const struct iommu_region *region;
+	unsigned int i;
+
+	hash = fingerprint_u32(hash, FINGERPRINT_REGIONS, group->nr_regions);
+	for (i = 0; i < group->nr_regions; i++) {
+		region = &group->regions[i];
+		hash = fingerprint_u64(hash, FINGERPRINT_REGION_START,
+				       region->start);
+		hash = fingerprint_u64(hash, FINGERPRINT_REGION_END,
+				       region->end);
+		hash = fingerprint_u32(hash, FINGERPRINT_REGION_TYPE,
+				       region->type);
+	}
+
+	return hash;
+}
+
+/* The bridges are hashed from the root port down. */
+static uint64_t fingerprint_upstream(uint64_t hash,
+				     const struct iommu_group *group)
+{
+	unsigned int i;
+
+	hash = fingerprint_u32(hash, FINGERPRINT_UPSTREAM,
+			       group->nr_upstream);
+	for (i = 0; i < group->nr_upstream; i++) {
+		hash = fingerprint_u32(hash, FINGERPRINT_BRIDGE,
+				       group->upstream[i].addr);
+		hash = fingerprint_acs(hash, &group->upstream[i].acs);
+	}
+
+	return hash;
+}
+
+/*
+ * 64-bit FNV-1a over the decoded groups and devices rather than over any
+ * output format. The groups must be sorted with iommu_groups_sort(), and
+ * read with every attribute in IOMMU_READ_ATTRIBUTES for a value that does
+ * not depend on the options. The VFIO state is derived from the hashed
+ * fields and is not hashed itself.
+ */
+uint64_t iommu_groups_fingerprint(const struct iommu_group *groups,
+				  unsigned int nr_groups)
+{
+	uint64_t hash = FNV1A_64_OFFSET;
+	unsigned int i, j;
+
+	for (i = 0; i < nr_groups; i++) {
+		hash = fingerprint_u32(hash, FINGERPRINT_GROUP,
+				       groups[i].group_id);
+
+		for (j = 0; j < groups[i].nr_devices; j++)
+			hash = fingerprint_device(hash, &groups[i].devices[j]);
+
+		if (groups[i].has_regions)
+			hash = fingerprint_regions(hash, &groups[i]);
+
+		if (groups[i].has_upstream)
+			hash = fingerprint_upstream(hash, &groups[i]);
+	}
+
+	return hash;
+}
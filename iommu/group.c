@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iommu.h"
+
+#define IOMMU_GROUPS_MIN_CAPACITY 64
+
+DEFINE_HASH_MAP(iommu_group_map, uint32_t, unsigned int)
+DEFINE_HASH_MAP(iommu_physfn_map, uint32_t, struct iommu_physfn)
+
+static bool iommu_groups_index(struct iommu_groups *list)
+{
+	unsigned int i;
+
+	iommu_group_map_clear(&list->map);
+	for (i = 0; i < list->nr_groups; i++)
+		if (!iommu_group_map_insert(&list->map,
+					    list->groups[i].group_id, i))
+			return false;
+
+	return true;
+}
+
+/* Returns the group with @group_id, adding it when needed. */
+struct iommu_group *iommu_groups_get(struct iommu_groups *list,
+				     unsigned int group_id)
+{
+	struct iommu_group *groups;
+	struct iommu_group *group;
+	unsigned int capacity;
+	unsigned int *index;
+
+	index = iommu_group_map_find(&list->map, group_id);
+	if (index && (*index >= list->nr_groups ||
+		      list->groups[*index].group_id != group_id)) {
+		/* The groups were moved after the map was updated. */
+		if (!iommu_groups_index(list))
+			return NULL;
+
+		index = iommu_group_map_find(&list->map, group_id);
+	}
+
+	if (index)
+		return &list->groups[*index];
+
+	if (list->nr_groups == list->capacity) {
+		capacity = list->capacity ? list->capacity * 2 :
+					    IOMMU_GROUPS_MIN_CAPACITY;
+		groups = realloc(list->groups, capacity * sizeof(*groups));
+		if (!groups)
+			return NULL;
+
+		list->groups = groups;
+		list->capacity = capacity;
+	}
+
+	if (!iommu_group_map_insert(&list->map, group_id, list->nr_groups))
+		return NULL;
+
+	group = &list->groups[list->nr_groups++];
+	memset(group, 0, sizeof(*group));
+	group->group_id = group_id;
+	group->vfio = IOMMU_VFIO_UNKNOWN;
+
+	return group;
+}
+
+/* Appends a copy of @dev to the group. */
+bool iommu_group_add_device(struct iommu_group *group,
+			    const struct pci_device *dev)
+{
+	struct pci_device *devices;
+	unsigned int capacity;
+
+	if (group->nr_devices == group->capacity) {
+		capacity = group->capacity ? group->capacity * 2 : 1;
+		devices = realloc(group->devices,
+				  capacity * sizeof(*devices));
+		if (!devices)
+			return false;
+
+		group->devices = devices;
+		group->capacity = capacity;
+	}
+
+	memcpy(&group->devices[group->nr_devices++], dev, sizeof(*dev));
+	return true;
+}
+
+/* Returns the physical function at @addr collected while reading, if any. */
+struct iommu_physfn *iommu_groups_find_physfn(const struct iommu_groups *list,
+					      uint32_t addr)
+{
+	return iommu_physfn_map_find(&list->physfns, addr);
+}
+
+/* Adds a copy of @pf and returns it, or returns NULL without memory. */
+struct iommu_physfn *iommu_groups_add_physfn(struct iommu_groups *list,
+					     uint32_t addr,
+					     const struct iommu_physfn *pf)
+{
+	if (!iommu_physfn_map_insert(&list->physfns, addr, *pf))
+		return NULL;
+
+	return iommu_physfn_map_find(&list->physfns, addr);
+}
+
+void iommu_groups_release_physfns(struct iommu_groups *list)
+{
+	iommu_physfn_map_free(&list->physfns);
+	list->physfn_missed = false;
+}
+
+void iommu_group_free(struct iommu_group *group)
+{
+	free(group->devices);
+	group->devices = NULL;
+	group->nr_devices = 0;
+	group->capacity = 0;
+
+	free(group->regions);
+	group->regions = NULL;
+	group->nr_regions = 0;
+
+	free(group->upstream);
+	group->upstream = NULL;
+	group->nr_upstream = 0;
+}
+
+void iommu_groups_free(struct iommu_groups *list)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->nr_groups; i++)
+		iommu_group_free(&list->groups[i]);
+
+	free(list->groups);
+	list->groups = NULL;
+	list->nr_groups = 0;
+	list->capacity = 0;
+
+	iommu_group_map_free(&list->map);
+	iommu_groups_release_physfns(list);
+}
@@ -5,112 +5,269 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "iommu.h"
+#include "output.h"
 #include "pci.h"
-#include "string-buffer.h"
 
-#define IOMMU_JSON_BUFFER_SIZE 65536
+void iommu_json_append_string(struct output *out, const char *str)
+{
+	const char *start = str;
+	unsigned char c;
+
+	output_char(out, '"');
+
+	for (; *str; str++) {
+		c = *str;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		output_write(out, start, str - start);
+		output_str(out, "\\u00");
+		output_hex(out, c, 2);
+		start = str + 1;
+	}
 
-alignas(struct string_buffer) static uint8_t iommu_json_buffer[IOMMU_JSON_BUFFER_SIZE];
+	output_write(out, start, str - start);
+	output_char(out, '"');
+}
 
-static void iommu_json_append_attribute(struct string_buffer *buf,
-					const char *key, const char *value)
+static void iommu_json_append_attribute(struct output *out, const char *key,
+					const char *value)
 {
-	size_t i;
-	char c;
-	char tmp[7];
+	iommu_json_append_string(out, key);
+	output_char(out, ':');
+	iommu_json_append_string(out, value);
+}
+
+static void iommu_json_append_pci(struct output *out, struct pci_device *dev)
+{
+	output_char(out, ',');
+	iommu_json_append_attribute(out, "class", dev->class + 2);
+	output_char(out, ',');
+	iommu_json_append_attribute(out, "vendor", dev->vendor + 2);
+	output_char(out, ',');
+	iommu_json_append_attribute(out, "device", dev->device + 2);
+	if (dev->has_revision) {
+		output_char(out, ',');
+		iommu_json_append_attribute(out, "revision", dev->revision + 2);
+	}
+}
+
+static void iommu_json_append_locality(struct output *out,
+				       struct pci_locality *loc)
+{
+	char speed[PCI_LINK_SPEED_STRING_SIZE];
+
+	if (loc->flags & PCI_LOCALITY_NUMA) {
+		output_str(out, ",\"numa_node\":");
+		if (loc->numa_node < 0)
+			output_char(out, '-');
+		output_dec(out, abs(loc->numa_node), 0);
+	}
 
-	string_buffer_append(buf, "\"");
-	for (i = 0; key[i]; i++) {
-		c = key[i];
-		if ((unsigned char)c < 0x20 || c == '"' || c == '\\') {
-			snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned char)c);
-			string_buffer_append(buf, tmp);
-		} else {
-			string_buffer_append(buf, (char[]){ c, 0 });
-		}
+	if (loc->flags & PCI_LOCALITY_CPULIST) {
+		output_char(out, ',');
+		iommu_json_append_attribute(out, "local_cpulist", loc->cpulist);
 	}
-	string_buffer_append(buf, "\":\"");
-	for (i = 0; value[i]; i++) {
-		c = value[i];
-		if ((unsigned char)c < 0x20 || c == '"' || c == '\\') {
-			snprintf(tmp, sizeof(tmp), "\\u%04x", (unsigned char)c);
-			string_buffer_append(buf, tmp);
-		} else {
-			string_buffer_append(buf, (char[]){ c, 0 });
-		}
+
+	if (loc->flags & PCI_LOCALITY_LINK) {
+		output_str(out, ",\"link_speed\":\"");
+		output_write(out, speed,
+			     pci_encode_link_speed(speed, loc->link_speed) -
+				     speed);
+		output_str(out, " GT/s\",\"link_width\":");
+		output_dec(out, loc->link_width, 0);
 	}
-	string_buffer_append(buf, "\"");
 }
 
-static void iommu_json_append_pci(struct string_buffer *buf,
-				  struct pci_device *dev)
+static void iommu_json_append_binding(struct output *out,
+				      struct pci_binding *binding)
 {
-	string_buffer_append(buf, ",");
-	iommu_json_append_attribute(buf, "class", dev->class + 2);
-	string_buffer_append(buf, ",");
-	iommu_json_append_attribute(buf, "vendor", dev->vendor + 2);
-	string_buffer_append(buf, ",");
-	iommu_json_append_attribute(buf, "device", dev->device + 2);
-	if (dev->has_revision) {
-		string_buffer_append(buf, ",");
-		iommu_json_append_attribute(buf, "revision", dev->revision + 2);
+	if (binding->flags & PCI_BINDING_DRIVER) {
+		output_str(out, ",\"driver\":");
+		if (binding->driver[0])
+			iommu_json_append_string(out, binding->driver);
+		else
+			output_str(out, "null");
+	}
+
+	if (binding->flags & PCI_BINDING_HEADER) {
+		output_str(out, ",\"header_type\":");
+		output_dec(out, binding->header_type, 0);
 	}
 }
 
-const struct string_buffer *iommu_to_json(struct iommu_group *groups,
-					  unsigned int nr_groups)
+static void iommu_json_append_sriov(struct output *out,
+				    struct pci_sriov *sriov)
 {
-	struct string_buffer *buf = (struct string_buffer *)iommu_json_buffer;
-	struct iommu_group *group;
-	struct pci_device *dev;
-	unsigned int i, j;
-	char tmp[32];
+	if (sriov->flags & PCI_SRIOV_PHYSFN) {
+		output_str(out, ",\"nr_virtfn\":");
+		output_dec(out, sriov->nr_virtfn, 0);
+	}
 
-	buf->capacity = IOMMU_JSON_BUFFER_SIZE - sizeof(struct string_buffer);
-	string_buffer_clear(buf);
+	if (sriov->flags & PCI_SRIOV_VIRTFN) {
+		output_str(out, ",\"physfn\":\"");
+		output_pci_addr(out, sriov->physfn);
+		output_char(out, '"');
+	}
+}
 
-	string_buffer_append(buf, "{\"iommu_groups\":[");
+/* Leaves out the registers of a function whose lists were not walked. */
+static void iommu_json_append_acs(struct output *out,
+				  const struct pci_acs *acs)
+{
+	if (!(acs->flags & PCI_ACS_READ))
+		return;
+
+	output_str(out, ",\"acs\":");
+	if (!(acs->flags & PCI_ACS_PRESENT)) {
+		output_str(out, "null");
+		return;
+	}
 
-	for (i = 0; i < nr_groups; i++) {
-		group = &groups[i];
+	output_str(out, "{\"cap\":\"");
+	output_hex(out, acs->cap, 4);
+	output_str(out, "\",\"ctrl\":\"");
+	output_hex(out, acs->ctrl, 4);
+	output_str(out, "\"}");
+}
 
+static void iommu_json_append_upstream(struct output *out,
+				       struct iommu_group *group)
+{
+	unsigned int i;
+
+	output_str(out, ",\"upstream\":[");
+	for (i = 0; i < group->nr_upstream; i++) {
 		if (i > 0)
-			string_buffer_append(buf, ",");
+			output_char(out, ',');
+		output_str(out, "{\"address\":\"");
+		output_pci_addr(out, group->upstream[i].addr);
+		output_char(out, '"');
+		iommu_json_append_acs(out, &group->upstream[i].acs);
+		output_char(out, '}');
+	}
+	output_char(out, ']');
+}
 
-		string_buffer_append(buf, "{\"id\":");
-		snprintf(tmp, sizeof(tmp), "%u", group->group_id);
-		string_buffer_append(buf, tmp);
-		string_buffer_append(buf, ",\"devices\":[");
+static void iommu_json_append_regions(struct output *out,
+				      struct iommu_group *group)
+{
+	unsigned int i;
 
-		for (j = 0; j < group->nr_devices; j++) {
-			dev = &group->devices[j];
+	output_str(out, ",\"reserved_regions\":[");
+	for (i = 0; i < group->nr_regions; i++) {
+		if (i > 0)
+			output_char(out, ',');
+		output_char(out, '{');
+		iommu_region_write_json(out, &group->regions[i]);
+		output_char(out, '}');
+	}
+	output_char(out, ']');
+}
 
-			if (j > 0)
-				string_buffer_append(buf, ",");
+static void iommu_json_begin(struct output *out,
+			     const struct iommu_groups *list)
+{
+	output_str(out, "{\"fingerprint\":\"");
+	output_hex(out, list->fingerprint >> 32, 8);
+	output_hex(out, list->fingerprint, 8);
+	output_str(out, "\",\"iommu_groups\":[");
+}
 
-			string_buffer_append(buf, "{");
+static void iommu_json_group_begin(struct output *out,
+				   struct iommu_group *group,
+				   unsigned int index)
+{
+	if (index > 0)
+		output_char(out, ',');
 
-			pci_addr_to_string(dev->addr, tmp, sizeof(tmp));
-			iommu_json_append_attribute(buf, "address", tmp);
+	output_str(out, "{\"id\":");
+	output_dec(out, group->group_id, 0);
 
-			if (dev->valid)
-				iommu_json_append_pci(buf, dev);
+	if (group->vfio != IOMMU_VFIO_UNKNOWN) {
+		output_char(out, ',');
+		iommu_json_append_attribute(out, "vfio",
+					    iommu_vfio_state_name(group->vfio));
+	}
+
+	if (group->has_regions)
+		iommu_json_append_regions(out, group);
+
+	if (group->has_upstream)
+		iommu_json_append_upstream(out, group);
+
+	output_str(out, ",\"devices\":[");
+}
+
+static void iommu_json_device(struct output *out, struct iommu_group *group,
+			      struct pci_device *dev, unsigned int index)
+{
+	if (index > 0)
+		output_char(out, ',');
 
-			string_buffer_append(buf, "}");
-		}
+	output_str(out, "{\"address\":\"");
+	output_pci_addr(out, dev->addr);
+	output_char(out, '"');
 
-		string_buffer_append(buf, "]}");
+	if (dev->valid) {
+		iommu_json_append_pci(out, dev);
+		iommu_json_append_locality(out, &dev->locality);
+		iommu_json_append_binding(out, &dev->binding);
+		iommu_json_append_sriov(out, &dev->sriov);
+		iommu_json_append_acs(out, &dev->acs);
 	}
 
-	string_buffer_append(buf, "]}");
+	output_char(out, '}');
+}
+
+static void iommu_json_group_end(struct output *out, struct iommu_group *group,
+				 unsigned int index)
+{
+	output_str(out, "]}");
+}
+
+static void iommu_json_end(struct output *out,
+			   const struct iommu_groups *list)
+{
+	output_str(out, "]}\n");
+}
 
-	if (buf->status & STRING_BUFFER_OVERFLOW)
-		return NULL;
+const struct iommu_emitter iommu_json_emitter = {
+	.name = "json",
+	.fingerprint = true,
+	.begin = iommu_json_begin,
+	.group_begin = iommu_json_group_begin,
+	.device = iommu_json_device,
+	.group_end = iommu_json_group_end,
+	.end = iommu_json_end,
+};
 
-	return buf;
+/*
+ * NDJSON: one self-contained group object per line, so that consumers can
+ * process groups without buffering the whole document.
+ */
+static void iommu_ndjson_group_begin(struct output *out,
+				     struct iommu_group *group,
+				     unsigned int index)
+{
+	iommu_json_group_begin(out, group, 0);
 }
+
+static void iommu_ndjson_group_end(struct output *out,
+				   struct iommu_group *group,
+				   unsigned int index)
+{
+	output_str(out, "]}\n");
+}
+
+const struct iommu_emitter iommu_ndjson_emitter = {
+	.name = "ndjson",
+	.group_begin = iommu_ndjson_group_begin,
+	.device = iommu_json_device,
+	.group_end = iommu_ndjson_group_end,
+};
@@ -0,0 +1,670 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iommu.h"
+#include "pci.h"
+
+#define JSON_READER_BUFFER_SIZE 65536
+#define JSON_KEY_SIZE 32
+#define JSON_MAX_DEPTH 64
+
+/*
+ * Streaming reader for the documents written by the json and ndjson
+ * formats. The input is consumed in fixed-size chunks and never held in
+ * memory as a whole.
+ */
+struct json_reader {
+	int fd;
+	int error;
+	size_t pos;
+	size_t len;
+	uint8_t data[JSON_READER_BUFFER_SIZE];
+};
+
+static bool json_fill(struct json_reader *r)
+{
+	ssize_t len;
+
+	if (r->error)
+		return false;
+
+	for (;;) {
+		len = read(r->fd, r->data, sizeof(r->data));
+		if (len >= 0)
+			break;
+		if (errno != EINTR) {
+			r->error = -errno;
+			return false;
+		}
+	}
+
+	r->pos = 0;
+	r->len = len;
+	return len > 0;
+}
+
+/* Returns the next byte without consuming it, or -1 at the end. */
+static int json_peek_raw(struct json_reader *r)
+{
+	if (r->pos == r->len && !json_fill(r))
+		return -1;
+
+	return r->data[r->pos];
+}
+
+static int json_getc_raw(struct json_reader *r)
+{
+	int c = json_peek_raw(r);
+
+	if (c >= 0)
+		r->pos++;
+
+	return c;
+}
+
+/* As json_peek_raw() but skips whitespace first. */
+static int json_peek(struct json_reader *r)
+{
+	int c;
+
+	for (;;) {
+		c = json_peek_raw(r);
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+			return c;
+		r->pos++;
+	}
+}
+
+static int json_getc(struct json_reader *r)
+{
+	int c = json_peek(r);
+
+	if (c >= 0)
+		r->pos++;
+
+	return c;
+}
+
+static int json_fail(struct json_reader *r)
+{
+	if (!r->error)
+		r->error = -EINVAL;
+
+	return r->error;
+}
+
+static int json_expect(struct json_reader *r, char expected)
+{
+	if (json_peek(r) != expected)
+		return json_fail(r);
+
+	r->pos++;
+	return 0;
+}
+
+static int json_expect_literal(struct json_reader *r, const char *literal)
+{
+	if (json_peek(r) < 0)
+		return json_fail(r);
+
+	for (; *literal; literal++)
+		if (json_getc_raw(r) != *literal)
+			return json_fail(r);
+
+	return 0;
+}
+
+static int json_hex_digit(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return 10 + c - 'a';
+	if (c >= 'A' && c <= 'F')
+		return 10 + c - 'A';
+	return -1;
+}
+
+/*
+ * Reads a string into @dst. Escapes outside of ASCII are replaced with
+ * '?', which is enough for the attributes written by lsiommu. A string
+ * that does not fit is an error unless @overflow is given, in which case
+ * the string is truncated and *@overflow set. A NULL @dst skips the string.
+ */
+static int json_read_chars(struct json_reader *r, char *dst, size_t size,
+			   bool *overflow)
+{
+	unsigned int code;
+	size_t len = 0;
+	int c, i, digit;
+
+	if (json_expect(r, '"') < 0)
+		return r->error;
+
+	for (;;) {
+		c = json_getc_raw(r);
+		if (c < 0)
+			return json_fail(r);
+
+		if (c == '"')
+			break;
+
+		if (c == '\\') {
+			c = json_getc_raw(r);
+			switch (c) {
+			case '"':
+			case '\\':
+			case '/':
+				break;
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'u':
+				code = 0;
+				for (i = 0; i < 4; i++) {
+					digit = json_hex_digit(json_getc_raw(r));
+					if (digit < 0)
+						return json_fail(r);
+					code = (code << 4) | digit;
+				}
+				c = code < 0x80 ? (int)code : '?';
+				break;
+			default:
+				return json_fail(r);
+			}
+		}
+
+		if (!dst)
+			continue;
+
+		if (len + 1 >= size) {
+			if (!overflow)
+				return json_fail(r);
+			*overflow = true;
+			continue;
+		}
+
+		dst[len++] = c;
+	}
+
+	if (dst)
+		dst[len] = '\0';
+
+	return 0;
+}
+
+static int json_read_string(struct json_reader *r, char *dst, size_t size)
+{
+	return json_read_chars(r, dst, size, NULL);
+}
+
+static int json_read_int(struct json_reader *r, long *value)
+{
+	bool negative = false;
+	bool digits = false;
+	long acc = 0;
+	int c;
+
+	if (json_peek(r) == '-') {
+		negative = true;
+		r->pos++;
+	}
+
+	for (;;) {
+		c = json_peek_raw(r);
+		if (c < '0' || c > '9')
+			break;
+
+		if (acc > (INT32_MAX - 9) / 10)
+			return json_fail(r);
+
+		acc = acc * 10 + c - '0';
+		digits = true;
+		r->pos++;
+	}
+
+	if (!digits)
+		return json_fail(r);
+
+	*value = negative ? -acc : acc;
+	return 0;
+}
+
+static int json_skip_value(struct json_reader *r, unsigned int depth);
+
+static int json_skip_container(struct json_reader *r, char close,
+			       unsigned int depth)
+{
+	int c;
+
+	r->pos++;
+
+	if (json_peek(r) == close) {
+		r->pos++;
+		return 0;
+	}
+
+	for (;;) {
+		if (close == '}') {
+			if (json_read_string(r, NULL, 0) < 0 ||
+			    json_expect(r, ':') < 0)
+				return r->error;
+		}
+
+		if (json_skip_value(r, depth + 1) < 0)
+			return r->error;
+
+		c = json_getc(r);
+		if (c == close)
+			return 0;
+		if (c != ',')
+			return json_fail(r);
+	}
+}
+
+static int json_skip_value(struct json_reader *r, unsigned int depth)
+{
+	int c = json_peek(r);
+
+	if (depth > JSON_MAX_DEPTH)
+		return json_fail(r);
+
+	switch (c) {
+	case '{':
+		return json_skip_container(r, '}', depth);
+	case '[':
+		return json_skip_container(r, ']', depth);
+	case '"':
+		return json_read_string(r, NULL, 0);
+	case 't':
+		return json_expect_literal(r, "true");
+	case 'f':
+		return json_expect_literal(r, "false");
+	case 'n':
+		return json_expect_literal(r, "null");
+	default:
+		break;
+	}
+
+	if (c != '-' && (c < '0' || c > '9'))
+		return json_fail(r);
+
+	for (;;) {
+		c = json_peek_raw(r);
+		if (!(c == '-' || c == '+' || c == '.' || c == 'e' ||
+		      c == 'E' || (c >= '0' && c <= '9')))
+			return 0;
+		r->pos++;
+	}
+}
+
+/*
+ * Calls @member for each key of an object. The callback must consume the
+ * value.
+ */
+static int json_read_object(struct json_reader *r,
+			    int (*member)(struct json_reader *r,
+					  const char *key, void *ctx),
+			    void *ctx)
+{
+	char key[JSON_KEY_SIZE];
+	bool overflow;
+	int c;
+
+	if (json_expect(r, '{') < 0)
+		return r->error;
+
+	if (json_peek(r) == '}') {
+		r->pos++;
+		return 0;
+	}
+
+	for (;;) {
+		if (json_peek(r) != '"')
+			return json_fail(r);
+
+		overflow = false;
+		if (json_read_chars(r, key, sizeof(key), &overflow) < 0 ||
+		    json_expect(r, ':') < 0)
+			return r->error;
+
+		/* Keys that do not fit are not in the schema. */
+		if (overflow) {
+			if (json_skip_value(r, 0) < 0)
+				return r->error;
+		} else if (member(r, key, ctx) < 0) {
+			return r->error;
+		}
+
+		c = json_getc(r);
+		if (c == '}')
+			return 0;
+		if (c != ',')
+			return json_fail(r);
+	}
+}
+
+static int json_read_array(struct json_reader *r,
+			   int (*element)(struct json_reader *r, void *ctx),
+			   void *ctx)
+{
+	int c;
+
+	if (json_expect(r, '[') < 0)
+		return r->error;
+
+	if (json_peek(r) == ']') {
+		r->pos++;
+		return 0;
+	}
+
+	for (;;) {
+		if (element(r, ctx) < 0)
+			return r->error;
+
+		c = json_getc(r);
+		if (c == ']')
+			return 0;
+		if (c != ',')
+			return json_fail(r);
+	}
+}
+
+/* Reads a property such as "8086" and stores it as "0x8086". */
+static int iommu_load_property(struct json_reader *r, char *prop,
+			       size_t size)
+{
+	prop[0] = '0';
+	prop[1] = 'x';
+	return json_read_string(r, prop + 2, size - 2);
+}
+
+static int iommu_load_addr(struct json_reader *r, uint32_t *addr)
+{
+	char str[PCI_ADDR_STRING_SIZE];
+
+	if (json_read_string(r, str, sizeof(str)) < 0)
+		return r->error;
+
+	if (pci_string_to_addr(str, addr) < 0)
+		return json_fail(r);
+
+	return 0;
+}
+
+static int iommu_load_device_member(struct json_reader *r, const char *key,
+				    void *ctx)
+{
+	struct pci_device *dev = ctx;
+	char str[PCI_LINK_SPEED_STRING_SIZE];
+	long value;
+
+	if (strcmp(key, "address") == 0)
+		return iommu_load_addr(r, &dev->addr);
+
+	if (strcmp(key, "class") == 0) {
+		dev->valid = true;
+		return iommu_load_property(r, dev->class, sizeof(dev->class));
+	}
+
+	if (strcmp(key, "vendor") == 0)
+		return iommu_load_property(r, dev->vendor,
+					   sizeof(dev->vendor));
+
+	if (strcmp(key, "device") == 0)
+		return iommu_load_property(r, dev->device,
+					   sizeof(dev->device));
+
+	if (strcmp(key, "revision") == 0) {
+		dev->has_revision = true;
+		return iommu_load_property(r, dev->revision,
+					   sizeof(dev->revision));
+	}
+
+	if (strcmp(key, "numa_node") == 0) {
+		if (json_read_int(r, &value) < 0)
+			return r->error;
+		dev->locality.numa_node = value;
+		dev->locality.flags |= PCI_LOCALITY_NUMA;
+		return 0;
+	}
+
+	if (strcmp(key, "local_cpulist") == 0) {
+		dev->locality.flags |= PCI_LOCALITY_CPULIST;
+		return json_read_string(r, dev->locality.cpulist,
+					sizeof(dev->locality.cpulist));
+	}
+
+	if (strcmp(key, "link_speed") == 0) {
+		if (json_read_string(r, str, sizeof(str)) < 0)
+			return r->error;
+		if (pci_parse_link_speed(str, &dev->locality.link_speed) < 0)
+			return json_fail(r);
+		dev->locality.flags |= PCI_LOCALITY_LINK;
+		return 0;
+	}
+
+	if (strcmp(key, "link_width") == 0) {
+		if (json_read_int(r, &value) < 0)
+			return r->error;
+		dev->locality.link_width = value;
+		return 0;
+	}
+
+	if (strcmp(key, "driver") == 0) {
+		dev->binding.flags |= PCI_BINDING_DRIVER;
+		if (json_peek(r) == 'n') {
+			dev->binding.driver[0] = '\0';
+			return json_expect_literal(r, "null");
+		}
+		return json_read_string(r, dev->binding.driver,
+					sizeof(dev->binding.driver));
+	}
+
+	if (strcmp(key, "header_type") == 0) {
+		if (json_read_int(r, &value) < 0)
+			return r->error;
+		dev->binding.header_type = value;
+		dev->binding.flags |= PCI_BINDING_HEADER;
+		return 0;
+	}
+
+	if (strcmp(key, "physfn") == 0) {
+		dev->sriov.flags |= PCI_SRIOV_VIRTFN;
+		return iommu_load_addr(r, &dev->sriov.physfn);
+	}
+
+	if (strcmp(key, "nr_virtfn") == 0) {
+		if (json_read_int(r, &value) < 0)
+			return r->error;
+		dev->sriov.nr_virtfn = value;
+		dev->sriov.flags |= PCI_SRIOV_PHYSFN;
+		return 0;
+	}
+
+	return json_skip_value(r, 0);
+}
+
+static int iommu_load_device(struct json_reader *r, void *ctx)
+{
+	struct iommu_group *group = ctx;
+	struct pci_device dev;
+
+	memset(&dev, 0, sizeof(dev));
+
+	if (json_read_object(r, iommu_load_device_member, &dev) < 0)
+		return r->error;
+
+	if (!iommu_group_add_device(group, &dev)) {
+		r->error = -ENOMEM;
+		return r->error;
+	}
+
+	return 0;
+}
+
+struct iommu_load_ctx {
+	struct iommu_groups *list;
+	struct iommu_group group;
+	bool has_group;
+	bool has_id;
+	long group_id;
+};
+
+static int iommu_load_group_member(struct json_reader *r, const char *key,
+				   void *ptr)
+{
+	struct iommu_load_ctx *ctx = ptr;
+	char str[JSON_KEY_SIZE];
+
+	if (strcmp(key, "id") == 0) {
+		ctx->has_group = true;
+		ctx->has_id = true;
+		if (json_read_int(r, &ctx->group_id) < 0)
+			return r->error;
+		if (ctx->group_id < 0)
+			return json_fail(r);
+		return 0;
+	}
+
+	if (strcmp(key, "vfio") == 0) {
+		if (json_read_string(r, str, sizeof(str)) < 0)
+			return r->error;
+		ctx->group.vfio = iommu_vfio_state_from_name(str);
+		return 0;
+	}
+
+	if (strcmp(key, "devices") == 0) {
+		ctx->has_group = true;
+		return json_read_array(r, iommu_load_device, &ctx->group);
+	}
+
+	return json_skip_value(r, 0);
+}
+
+/* Moves the parsed group into the list. */
+static int iommu_load_commit_group(struct json_reader *r,
+				   struct iommu_load_ctx *ctx)
+{
+	struct iommu_group *target;
+	unsigned int i;
+
+	if (!ctx->has_id) {
+		iommu_group_free(&ctx->group);
+		return json_fail(r);
+	}
+
+	target = iommu_groups_get(ctx->list, ctx->group_id);
+	if (!target)
+		goto err;
+
+	target->vfio = ctx->group.vfio;
+
+	if (target->nr_devices == 0) {
+		free(target->devices);
+		target->devices = ctx->group.devices;
+		target->nr_devices = ctx->group.nr_devices;
+		target->capacity = ctx->group.capacity;
+		memset(&ctx->group, 0, sizeof(ctx->group));
+		return 0;
+	}
+
+	for (i = 0; i < ctx->group.nr_devices; i++)
+		if (!iommu_group_add_device(target, &ctx->group.devices[i]))
+			goto err;
+
+	iommu_group_free(&ctx->group);
+	return 0;
+
+err:
+	iommu_group_free(&ctx->group);
+	r->error = -ENOMEM;
+	return r->error;
+}
+
+static int iommu_load_group(struct json_reader *r, void *ptr)
+{
+	struct iommu_load_ctx *ctx = ptr;
+	struct iommu_load_ctx group_ctx = { .list = ctx->list };
+
+	if (json_read_object(r, iommu_load_group_member, &group_ctx) < 0) {
+		iommu_group_free(&group_ctx.group);
+		return r->error;
+	}
+
+	return iommu_load_commit_group(r, &group_ctx);
+}
+
+/*
+ * Members of a top-level object. A json document has "iommu_groups", and
+ * an ndjson line is a group object of its own.
+ */
+static int iommu_load_top_member(struct json_reader *r, const char *key,
+				 void *ptr)
+{
+	struct iommu_load_ctx *ctx = ptr;
+
+	if (strcmp(key, "iommu_groups") == 0)
+		return json_read_array(r, iommu_load_group, ctx);
+
+	return iommu_load_group_member(r, key, ctx);
+}
+
+/*
+ * Loads groups written with --format json or --format ndjson from @fd.
+ * The groups are not sorted.
+ */
+int iommu_groups_load(int fd, struct iommu_groups *list)
+{
+	struct iommu_load_ctx ctx;
+	struct json_reader *r;
+	int ret = 0;
+
+	r = malloc(sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+
+	r->fd = fd;
+	r->error = 0;
+	r->pos = 0;
+	r->len = 0;
+
+	while (json_peek(r) >= 0) {
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.list = list;
+
+		if (json_read_object(r, iommu_load_top_member, &ctx) < 0) {
+			iommu_group_free(&ctx.group);
+			break;
+		}
+
+		if (ctx.has_group && iommu_load_commit_group(r, &ctx) < 0)
+			break;
+	}
+
+	ret = r->error;
+	free(r);
+	return ret;
+}
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "iommu.h"
+#include "output.h"
+#include "pci.h"
+
+static void iommu_plain_append_pci(struct output *out, struct pci_device *dev)
+{
+	output_str(out, " Class ");
+	output_str(out, dev->class + 2);
+	output_str(out, " ID ");
+	output_str(out, dev->vendor + 2);
+	output_char(out, ':');
+	output_str(out, dev->device + 2);
+
+	if (dev->has_revision) {
+		output_str(out, " Revision ");
+		output_str(out, dev->revision + 2);
+	}
+}
+
+static void iommu_plain_append_locality(struct output *out,
+					struct pci_locality *loc)
+{
+	char speed[PCI_LINK_SPEED_STRING_SIZE];
+
+	if (loc->flags & PCI_LOCALITY_NUMA) {
+		output_str(out, " NUMA ");
+		if (loc->numa_node < 0)
+			output_char(out, '-');
+		output_dec(out, abs(loc->numa_node), 0);
+	}
+
+	if (loc->flags & PCI_LOCALITY_CPULIST) {
+		output_str(out, " CPUs ");
+		output_str(out, loc->cpulist);
+	}
+
+	if (loc->flags & PCI_LOCALITY_LINK) {
+		output_str(out, " Speed ");
+		output_write(out, speed,
+			     pci_encode_link_speed(speed, loc->link_speed) -
+				     speed);
+		output_str(out, " GT/s Width ");
+		output_dec(out, loc->link_width, 0);
+	}
+}
+
+static void iommu_plain_append_binding(struct output *out,
+				       struct pci_binding *binding)
+{
+	if (!(binding->flags & PCI_BINDING_DRIVER))
+		return;
+
+	output_str(out, " Driver ");
+	output_str(out, binding->driver[0] ? binding->driver : "none");
+}
+
+static void iommu_plain_append_sriov(struct output *out,
+				     struct pci_sriov *sriov)
+{
+	if (sriov->flags & PCI_SRIOV_PHYSFN) {
+		output_str(out, " VFs ");
+		output_dec(out, sriov->nr_virtfn, 0);
+	}
+
+	if (sriov->flags & PCI_SRIOV_VIRTFN) {
+		output_str(out, " PF ");
+		output_pci_addr(out, sriov->physfn);
+	}
+}
+
+/* The ACS control register, or "none" without the capability. */
+static void iommu_plain_append_acs_ctrl(struct output *out,
+					const struct pci_acs *acs)
+{
+	if (acs->flags & PCI_ACS_PRESENT)
+		output_hex(out, acs->ctrl, 4);
+	else
+		output_str(out, "none");
+}
+
+static void iommu_plain_append_upstream(struct output *out,
+					const struct iommu_group *group)
+{
+	const struct iommu_bridge *bridge;
+	unsigned int i;
+
+	output_str(out, " Upstream ");
+	if (!group->nr_upstream)
+		output_char(out, '-');
+
+	for (i = 0; i < group->nr_upstream; i++) {
+		bridge = &group->upstream[i];
+		if (i > 0)
+			output_char(out, ',');
+		output_pci_addr(out, bridge->addr);
+		if (bridge->acs.flags & PCI_ACS_READ) {
+			output_char(out, '(');
+			iommu_plain_append_acs_ctrl(out, &bridge->acs);
+			output_char(out, ')');
+		}
+	}
+}
+
+static void iommu_plain_append_regions(struct output *out,
+				       const struct iommu_group *group)
+{
+	const struct iommu_region *region;
+	unsigned int i;
+
+	output_str(out, " Regions ");
+	if (!group->nr_regions)
+		output_char(out, '-');
+
+	for (i = 0; i < group->nr_regions; i++) {
+		region = &group->regions[i];
+		if (i > 0)
+			output_char(out, ',');
+		output_str(out, "0x");
+		output_hex(out, region->start >> 32, 8);
+		output_hex(out, region->start, 8);
+		output_str(out, "-0x");
+		output_hex(out, region->end >> 32, 8);
+		output_hex(out, region->end, 8);
+		output_char(out, '(');
+		output_str(out, iommu_region_type_name(region->type));
+		output_char(out, ')');
+	}
+}
+
+static void iommu_plain_device(struct output *out, struct iommu_group *group,
+			       struct pci_device *dev, unsigned int index)
+{
+	output_str(out, "Group ");
+	output_dec(out, group->group_id, 3);
+
+	if (dev->valid) {
+		output_str(out, " Address ");
+		output_pci_addr(out, dev->addr);
+		iommu_plain_append_pci(out, dev);
+		iommu_plain_append_locality(out, &dev->locality);
+		iommu_plain_append_binding(out, &dev->binding);
+		iommu_plain_append_sriov(out, &dev->sriov);
+		if (dev->acs.flags & PCI_ACS_READ) {
+			output_str(out, " ACS ");
+			iommu_plain_append_acs_ctrl(out, &dev->acs);
+		}
+	} else {
+		output_char(out, ' ');
+		output_pci_addr(out, dev->addr);
+		output_str(out, " N/A");
+	}
+
+	if (group->vfio != IOMMU_VFIO_UNKNOWN) {
+		output_str(out, " VFIO ");
+		output_str(out, iommu_vfio_state_name(group->vfio));
+	}
+
+	if (group->has_regions)
+		iommu_plain_append_regions(out, group);
+
+	if (group->has_upstream)
+		iommu_plain_append_upstream(out, group);
+
+	output_char(out, '\n');
+}
+
+const struct iommu_emitter iommu_plain_emitter = {
+	.name = "plain",
+	.device = iommu_plain_device,
+};
@@ -0,0 +1,361 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap-sort.h"
+#include "iommu.h"
+#include "output.h"
+#include "sysfs-file.h"
+
+#define SYSFS_IOMMU_GROUPS "/sys/kernel/iommu_groups"
+#define IOMMU_REGIONS_SIZE 4096
+
+static const char *const iommu_region_type_names[] = {
+	[IOMMU_REGION_DIRECT] = "direct",
+	[IOMMU_REGION_DIRECT_RELAXABLE] = "direct-relaxable",
+	[IOMMU_REGION_RESERVED] = "reserved",
+	[IOMMU_REGION_MSI] = "msi",
+	[IOMMU_REGION_SW_MSI] = "sw-msi",
+	[IOMMU_REGION_UNKNOWN] = "unknown",
+};
+
+const char *iommu_region_type_name(enum iommu_region_type type)
+{
+	return iommu_region_type_names[type];
+}
+
+static enum iommu_region_type iommu_region_type_from_name(const char *name,
+							  size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < IOMMU_REGION_UNKNOWN; i++)
+		if (strlen(iommu_region_type_names[i]) == len &&
+		    memcmp(iommu_region_type_names[i], name, len) == 0)
+			return i;
+
+	return IOMMU_REGION_UNKNOWN;
+}
+
+static inline bool iommu_region_less(const struct iommu_region *a,
+				     const struct iommu_region *b)
+{
+	if (a->start != b->start)
+		return a->start < b->start;
+	if (a->end != b->end)
+		return a->end < b->end;
+	return a->group_id < b->group_id;
+}
+
+DEFINE_HEAP_SORT(iommu_regions_sort, struct iommu_region, iommu_region_less)
+
+/* Regions of a subtree at this level or below are scanned in order. */
+#define IOMMU_REGIONS_SCAN_LEVEL 3
+#define IOMMU_REGIONS_MAX_LEVEL 64
+
+/*
+ * The sorted regions form an implicit binary tree, as in cgranges. The
+ * regions at even indices are the leaves, and a region whose index ends
+ * in k one bits is at level k, with children k - 1 levels down at
+ * i - 2^(k-1) and i + 2^(k-1). Indices past the end are empty nodes whose
+ * left subtrees can still have regions. Sets max_end of every region to
+ * the largest end in its subtree.
+ */
+static void iommu_regions_index(struct iommu_region *regions, size_t nr)
+{
+	size_t i, half, last_i = 0;
+	uint64_t last = 0, right;
+	unsigned int level;
+
+	iommu_regions_sort(regions, nr);
+
+	for (i = 0; i < nr; i += 2) {
+		regions[i].max_end = regions[i].end;
+		last_i = i;
+		last = regions[i].end;
+	}
+
+	/* @last is the max_end of the last subtree that has regions. */
+	for (level = 1; (size_t)1 << level <= nr; level++) {
+		half = (size_t)1 << (level - 1);
+
+		for (i = (half << 1) - 1; i < nr; i += half << 2) {
+			right = i + half < nr ? regions[i + half].max_end :
+						last;
+
+			regions[i].max_end = regions[i].end;
+			if (regions[i - half].max_end > regions[i].max_end)
+				regions[i].max_end = regions[i - half].max_end;
+			if (right > regions[i].max_end)
+				regions[i].max_end = right;
+		}
+
+		last_i = (last_i >> level) & 1 ? last_i - half : last_i + half;
+		if (last_i < nr && regions[last_i].max_end > last)
+			last = regions[last_i].max_end;
+	}
+}
+
+/*
+ * Parses lines of "<start> <end> <type>", where start and end are the
+ * inclusive bounds in hex. Malformed lines are skipped.
+ */
+static int iommu_group_parse_regions(struct iommu_group *group, char *buf)
+{
+	struct iommu_region *regions, *region;
+	unsigned int capacity = 0;
+	char *line, *next, *end;
+	size_t len;
+
+	for (line = buf; *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if (group->nr_regions == capacity) {
+			capacity = capacity ? capacity * 2 : 4;
+			regions = realloc(group->regions,
+					  capacity * sizeof(*regions));
+			if (!regions)
+				return -ENOMEM;
+
+			group->regions = regions;
+		}
+
+		region = &group->regions[group->nr_regions];
+		region->group_id = group->group_id;
+
+		region->start = strtoull(line, &end, 16);
+		if (end == line || *end != ' ')
+			continue;
+
+		line = end + 1;
+		region->end = strtoull(line, &end, 16);
+		if (end == line || *end != ' ' || region->end < region->start)
+			continue;
+
+		line = end + 1;
+		len = strcspn(line, " ");
+		region->type = iommu_region_type_from_name(line, len);
+
+		group->nr_regions++;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads /sys/kernel/iommu_groups/<id>/reserved_regions of every group into
+ * a per-group index. A group without the attribute gets no regions.
+ */
+void iommu_groups_read_regions(struct iommu_group *groups,
+			       unsigned int nr_groups)
+{
+	char path[sizeof(SYSFS_IOMMU_GROUPS) + 32];
+	char buf[IOMMU_REGIONS_SIZE];
+	struct iommu_group *group;
+	unsigned int i;
+
+	for (i = 0; i < nr_groups; i++) {
+		group = &groups[i];
+
+		snprintf(path, sizeof(path), "%s/%u", SYSFS_IOMMU_GROUPS,
+			 group->group_id);
+		if (sysfs_read_attr(path, "reserved_regions", buf,
+				    sizeof(buf)) < 0)
+			continue;
+
+		if (iommu_group_parse_regions(group, buf) < 0) {
+			free(group->regions);
+			group->regions = NULL;
+			group->nr_regions = 0;
+			continue;
+		}
+
+		iommu_regions_sort(group->regions, group->nr_regions);
+		group->has_regions = true;
+	}
+}
+
+int iommu_region_index_build(struct iommu_region_index *index,
+			     const struct iommu_group *groups,
+			     unsigned int nr_groups)
+{
+	size_t nr = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_groups; i++)
+		nr += groups[i].nr_regions;
+
+	index->regions = NULL;
+	index->nr_regions = 0;
+	if (!nr)
+		return 0;
+
+	index->regions = malloc(nr * sizeof(*index->regions));
+	if (!index->regions)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_groups; i++) {
+		memcpy(&index->regions[index->nr_regions], groups[i].regions,
+		       groups[i].nr_regions * sizeof(*index->regions));
+		index->nr_regions += groups[i].nr_regions;
+	}
+
+	iommu_regions_index(index->regions, index->nr_regions);
+	return 0;
+}
+
+void iommu_region_index_free(struct iommu_region_index *index)
+{
+	free(index->regions);
+	index->regions = NULL;
+	index->nr_regions = 0;
+}
+
+void iommu_region_write_json(struct output *out,
+			     const struct iommu_region *region)
+{
+	output_str(out, "\"start\":\"0x");
+	output_hex(out, region->start >> 32, 8);
+	output_hex(out, region->start, 8);
+	output_str(out, "\",\"end\":\"0x");
+	output_hex(out, region->end >> 32, 8);
+	output_hex(out, region->end, 8);
+	output_str(out, "\",\"type\":\"");
+	output_str(out, iommu_region_type_name(region->type));
+	output_char(out, '"');
+}
+
+static void iommu_region_record(struct output *out,
+				enum iommu_record_style style,
+				const struct iommu_region *region,
+				unsigned int index)
+{
+	if (style == IOMMU_RECORD_PLAIN) {
+		output_str(out, "group ");
+		output_dec(out, region->group_id, 0);
+		output_str(out, " start 0x");
+		output_hex(out, region->start >> 32, 8);
+		output_hex(out, region->start, 8);
+		output_str(out, " end 0x");
+		output_hex(out, region->end >> 32, 8);
+		output_hex(out, region->end, 8);
+		output_str(out, " type ");
+		output_str(out, iommu_region_type_name(region->type));
+		output_char(out, '\n');
+		return;
+	}
+
+	if (style == IOMMU_RECORD_JSON && index > 0)
+		output_char(out, ',');
+
+	output_str(out, "{\"group\":");
+	output_dec(out, region->group_id, 0);
+	output_char(out, ',');
+	iommu_region_write_json(out, region);
+	output_str(out, style == IOMMU_RECORD_JSON ? "}" : "}\n");
+}
+
+struct iommu_region_node {
+	size_t i;
+	unsigned int level;
+	bool left_done;
+};
+
+/*
+ * Writes the regions of all groups that overlap [@start, @end], ordered by
+ * their start, with an in-order walk of the interval tree. Left subtrees
+ * whose max_end is below @start are skipped, as are the right subtrees of
+ * the regions that start after @end, so each region found costs at most a
+ * walk down the tree instead of a scan of the regions before it. Returns
+ * the number of regions or a negative error.
+ */
+int iommu_check_range(struct output *out, enum iommu_record_style style,
+		      const struct iommu_region_index *index, uint64_t start,
+		      uint64_t end)
+{
+	struct iommu_region_node stack[IOMMU_REGIONS_MAX_LEVEL + 1];
+	const struct iommu_region *regions = index->regions;
+	size_t nr_regions = index->nr_regions;
+	struct iommu_region_node node;
+	size_t first, last, i, child;
+	unsigned int level = 0;
+	unsigned int nr = 0;
+	int top = 0;
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "{\"collisions\":[");
+
+	if (nr_regions) {
+		while ((size_t)2 << level <= nr_regions)
+			level++;
+
+		stack[top++] = (struct iommu_region_node){
+			((size_t)1 << level) - 1, level, false
+		};
+	}
+
+	while (top > 0) {
+		node = stack[--top];
+
+		if (node.level <= IOMMU_REGIONS_SCAN_LEVEL) {
+			first = node.i >> node.level << node.level;
+			last = first + ((size_t)2 << node.level) - 1;
+			if (last > nr_regions)
+				last = nr_regions;
+
+			for (i = first; i < last; i++) {
+				if (regions[i].start > end)
+					break;
+				if (regions[i].end >= start)
+					iommu_region_record(out, style,
+							    &regions[i], nr++);
+			}
+			continue;
+		}
+
+		if (!node.left_done) {
+			node.left_done = true;
+			stack[top++] = node;
+
+			child = node.i - ((size_t)1 << (node.level - 1));
+			if (child >= nr_regions ||
+			    regions[child].max_end >= start)
+				stack[top++] = (struct iommu_region_node){
+					child, node.level - 1, false
+				};
+			continue;
+		}
+
+		if (node.i >= nr_regions || regions[node.i].start > end)
+			continue;
+
+		if (regions[node.i].end >= start)
+			iommu_region_record(out, style, &regions[node.i], nr++);
+
+		stack[top++] = (struct iommu_region_node){
+			node.i + ((size_t)1 << (node.level - 1)),
+			node.level - 1, false
+		};
+	}
+
+	if (style == IOMMU_RECORD_JSON)
+		output_str(out, "]}\n");
+
+	if (out->error)
+		return out->error;
+
+	return nr;
+}
@@ -0,0 +1,440 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "output.h"
+#include "pci.h"
+
+#define SELECT_VALUE_SIZE 32
+
+enum iommu_select_field {
+	SELECT_ID,
+	SELECT_VFIO,
+	SELECT_ADDRESS,
+	SELECT_CLASS,
+	SELECT_VENDOR,
+	SELECT_DEVICE,
+	SELECT_REVISION,
+	SELECT_NUMA_NODE,
+	SELECT_LOCAL_CPULIST,
+	SELECT_LINK_SPEED,
+	SELECT_LINK_WIDTH,
+	SELECT_DRIVER,
+	SELECT_HEADER_TYPE,
+	SELECT_NR_VIRTFN,
+	SELECT_PHYSFN,
+};
+
+struct iommu_select_field_info {
+	const char *name;
+	bool device;
+	bool hex;
+};
+
+/* Field names are the keys of --format json. */
+static const struct iommu_select_field_info iommu_select_fields[] = {
+	[SELECT_ID] = { "id", false, false },
+	[SELECT_VFIO] = { "vfio", false, false },
+	[SELECT_ADDRESS] = { "address", true, false },
+	[SELECT_CLASS] = { "class", true, true },
+	[SELECT_VENDOR] = { "vendor", true, true },
+	[SELECT_DEVICE] = { "device", true, true },
+	[SELECT_REVISION] = { "revision", true, true },
+	[SELECT_NUMA_NODE] = { "numa_node", true, false },
+	[SELECT_LOCAL_CPULIST] = { "local_cpulist", true, false },
+	[SELECT_LINK_SPEED] = { "link_speed", true, false },
+	[SELECT_LINK_WIDTH] = { "link_width", true, false },
+	[SELECT_DRIVER] = { "driver", true, false },
+	[SELECT_HEADER_TYPE] = { "header_type", true, false },
+	[SELECT_NR_VIRTFN] = { "nr_virtfn", true, false },
+	[SELECT_PHYSFN] = { "physfn", true, false },
+};
+
+#define SELECT_NR_FIELDS \
+	(sizeof(iommu_select_fields) / sizeof(iommu_select_fields[0]))
+
+struct iommu_select_value {
+	const char *str;
+	bool number;
+	bool null;
+};
+
+static size_t select_ident_len(const char *p)
+{
+	size_t len = 0;
+
+	while ((p[len] >= 'a' && p[len] <= 'z') || p[len] == '_')
+		len++;
+
+	return len;
+}
+
+static int select_field_find(const char *name, size_t len, bool device)
+{
+	size_t i;
+
+	for (i = 0; i < SELECT_NR_FIELDS; i++)
+		if (iommu_select_fields[i].device == device &&
+		    strlen(iommu_select_fields[i].name) == len &&
+		    memcmp(iommu_select_fields[i].name, name, len) == 0)
+			return i;
+
+	return -EINVAL;
+}
+
+/*
+ * Parses "[field=pattern,field!=pattern,...]" at @p into @filters, and
+ * returns the end of the brackets, or NULL on a syntax error.
+ */
+static const char *select_compile_filters(const char *p, bool device,
+					  struct iommu_select_filter *filters,
+					  unsigned int *nr_filters)
+{
+	struct iommu_select_filter *filter;
+	size_t len;
+	int field;
+
+	if (*p != '[')
+		return p;
+
+	do {
+		if (*nr_filters == IOMMU_SELECT_FILTERS)
+			return NULL;
+
+		filter = &filters[(*nr_filters)++];
+		p++;
+
+		len = select_ident_len(p);
+		field = select_field_find(p, len, device);
+		if (field < 0)
+			return NULL;
+
+		filter->field = field;
+		p += len;
+
+		filter->negate = *p == '!';
+		if (filter->negate)
+			p++;
+
+		if (*p++ != '=')
+			return NULL;
+
+		/* Hex fields are matched without their "0x" prefix. */
+		if (iommu_select_fields[field].hex && p[0] == '0' &&
+		    (p[1] == 'x' || p[1] == 'X'))
+			p += 2;
+
+		len = strcspn(p, ",]");
+		if (len == 0 || len >= sizeof(filter->pattern))
+			return NULL;
+
+		memcpy(filter->pattern, p, len);
+		filter->pattern[len] = '\0';
+		p += len;
+	} while (*p == ',');
+
+	if (*p != ']')
+		return NULL;
+
+	return p + 1;
+}
+
+/*
+ * Compiles "group[filters].devices[filters].field", where everything
+ * after "group" is optional, and the field can also be a group field.
+ */
+int iommu_selector_compile(const char *expr, struct iommu_selector *sel)
+{
+	const char *p = expr;
+	size_t len;
+	int field;
+
+	memset(sel, 0, sizeof(*sel));
+	sel->field = -1;
+
+	if (strncmp(p, "group", 5) != 0)
+		return -EINVAL;
+
+	p = select_compile_filters(p + 5, false, sel->group_filters,
+				   &sel->nr_group_filters);
+	if (!p)
+		return -EINVAL;
+
+	if (*p == '.' && strncmp(p + 1, "devices", 7) == 0 &&
+	    select_ident_len(p + 1) == 7) {
+		sel->devices = true;
+		p = select_compile_filters(p + 8, true, sel->device_filters,
+					   &sel->nr_device_filters);
+		if (!p)
+			return -EINVAL;
+	}
+
+	if (*p == '.') {
+		p++;
+		len = select_ident_len(p);
+		field = select_field_find(p, len, sel->devices);
+		if (field < 0)
+			return -EINVAL;
+
+		sel->field = field;
+		p += len;
+	}
+
+	return *p == '\0' ? 0 : -EINVAL;
+}
+
+static char *select_encode_int(char *p, int value)
+{
+	if (value < 0) {
+		*p++ = '-';
+		value = -value;
+	}
+
+	return output_encode_dec(p, value, 0);
+}
+
+static bool select_group_value(const struct iommu_group *group,
+			       unsigned int field, char *buf,
+			       struct iommu_select_value *value)
+{
+	memset(value, 0, sizeof(*value));
+
+	switch (field) {
+	case SELECT_ID:
+		*output_encode_dec(buf, group->group_id, 0) = '\0';
+		value->str = buf;
+		value->number = true;
+		return true;
+	case SELECT_VFIO:
+		if (group->vfio == IOMMU_VFIO_UNKNOWN)
+			return false;
+		value->str = iommu_vfio_state_name(group->vfio);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool select_device_value(const struct pci_device *dev,
+				unsigned int field, char *buf,
+				struct iommu_select_value *value)
+{
+	const struct pci_locality *loc = &dev->locality;
+	const struct pci_binding *binding = &dev->binding;
+	const struct pci_sriov *sriov = &dev->sriov;
+	char *p = buf;
+
+	memset(value, 0, sizeof(*value));
+	value->str = buf;
+
+	if (field == SELECT_ADDRESS) {
+		pci_addr_to_string(dev->addr, buf, SELECT_VALUE_SIZE);
+		return true;
+	}
+
+	if (!dev->valid)
+		return false;
+
+	switch (field) {
+	case SELECT_CLASS:
+		value->str = dev->class + 2;
+		return true;
+	case SELECT_VENDOR:
+		value->str = dev->vendor + 2;
+		return true;
+	case SELECT_DEVICE:
+		value->str = dev->device + 2;
+		return true;
+	case SELECT_REVISION:
+		value->str = dev->revision + 2;
+		return dev->has_revision;
+	case SELECT_NUMA_NODE:
+		if (!(loc->flags & PCI_LOCALITY_NUMA))
+			return false;
+		p = select_encode_int(p, loc->numa_node);
+		value->number = true;
+		break;
+	case SELECT_LOCAL_CPULIST:
+		value->str = loc->cpulist;
+		return loc->flags & PCI_LOCALITY_CPULIST;
+	case SELECT_LINK_SPEED:
+		if (!(loc->flags & PCI_LOCALITY_LINK))
+			return false;
+		p = pci_encode_link_speed(p, loc->link_speed);
+		memcpy(p, " GT/s", 5);
+		p += 5;
+		break;
+	case SELECT_LINK_WIDTH:
+		if (!(loc->flags & PCI_LOCALITY_LINK))
+			return false;
+		p = output_encode_dec(p, loc->link_width, 0);
+		value->number = true;
+		break;
+	case SELECT_DRIVER:
+		if (!(binding->flags & PCI_BINDING_DRIVER))
+			return false;
+		/* An unbound device matches "none" and is null in JSON. */
+		value->str = binding->driver[0] ? binding->driver : "none";
+		value->null = !binding->driver[0];
+		return true;
+	case SELECT_HEADER_TYPE:
+		if (!(binding->flags & PCI_BINDING_HEADER))
+			return false;
+		p = output_encode_dec(p, binding->header_type, 0);
+		value->number = true;
+		break;
+	case SELECT_NR_VIRTFN:
+		if (!(sriov->flags & PCI_SRIOV_PHYSFN))
+			return false;
+		p = output_encode_dec(p, sriov->nr_virtfn, 0);
+		value->number = true;
+		break;
+	case SELECT_PHYSFN:
+		if (!(sriov->flags & PCI_SRIOV_VIRTFN))
+			return false;
+		pci_addr_to_string(sriov->physfn, buf, SELECT_VALUE_SIZE);
+		return true;
+	default:
+		return false;
+	}
+
+	*p = '\0';
+	return true;
+}
+
+/* A missing field fails "=" and passes "!=". */
+static bool select_filter_match(const struct iommu_select_filter *filter,
+				bool found,
+				const struct iommu_select_value *value)
+{
+	bool match = found && fnmatch(filter->pattern, value->str, 0) == 0;
+
+	return match != filter->negate;
+}
+
+static bool select_group_match(const struct iommu_selector *sel,
+			       const struct iommu_group *group)
+{
+	struct iommu_select_value value;
+	char buf[SELECT_VALUE_SIZE];
+	unsigned int i;
+	bool found;
+
+	for (i = 0; i < sel->nr_group_filters; i++) {
+		found = select_group_value(group, sel->group_filters[i].field,
+					   buf, &value);
+		if (!select_filter_match(&sel->group_filters[i], found,
+					 &value))
+			return false;
+	}
+
+	return true;
+}
+
+static bool select_device_match(const struct iommu_selector *sel,
+				const struct pci_device *dev)
+{
+	struct iommu_select_value value;
+	char buf[SELECT_VALUE_SIZE];
+	unsigned int i;
+	bool found;
+
+	for (i = 0; i < sel->nr_device_filters; i++) {
+		found = select_device_value(dev, sel->device_filters[i].field,
+					    buf, &value);
+		if (!select_filter_match(&sel->device_filters[i], found,
+					 &value))
+			return false;
+	}
+
+	return true;
+}
+
+static void select_write_value(struct output *out,
+			       enum iommu_record_style style,
+			       const struct iommu_select_value *value)
+{
+	if (style == IOMMU_RECORD_PLAIN || value->number)
+		output_str(out, value->str);
+	else if (value->null)
+		output_str(out, "null");
+	else
+		iommu_json_append_string(out, value->str);
+
+	output_char(out, '\n');
+}
+
+/* Objects are always written as JSON, one per line. */
+static void select_write_group(struct output *out, struct iommu_group *group)
+{
+	const struct iommu_emitter *json = &iommu_json_emitter;
+	unsigned int i;
+
+	json->group_begin(out, group, 0);
+	for (i = 0; i < group->nr_devices; i++)
+		json->device(out, group, &group->devices[i], i);
+	json->group_end(out, group, 0);
+	output_char(out, '\n');
+}
+
+static void select_device(struct output *out, enum iommu_record_style style,
+			  const struct iommu_selector *sel,
+			  struct iommu_group *group, struct pci_device *dev)
+{
+	struct iommu_select_value value;
+	char buf[SELECT_VALUE_SIZE];
+
+	if (!select_device_match(sel, dev))
+		return;
+
+	if (sel->field < 0) {
+		iommu_json_emitter.device(out, group, dev, 0);
+		output_char(out, '\n');
+	} else if (select_device_value(dev, sel->field, buf, &value)) {
+		select_write_value(out, style, &value);
+	}
+}
+
+/*
+ * Writes the values or objects selected by @sel, one per line. Fields that
+ * a group or device does not have are skipped.
+ */
+int iommu_select(struct output *out, enum iommu_record_style style,
+		 const struct iommu_selector *sel, struct iommu_group *groups,
+		 unsigned int nr_groups)
+{
+	struct iommu_select_value value;
+	char buf[SELECT_VALUE_SIZE];
+	struct iommu_group *group;
+	unsigned int i, j;
+
+	for (i = 0; i < nr_groups; i++) {
+		group = &groups[i];
+
+		if (!select_group_match(sel, group))
+			continue;
+
+		if (sel->devices) {
+			for (j = 0; j < group->nr_devices; j++)
+				select_device(out, style, sel, group,
+					      &group->devices[j]);
+		} else if (sel->field < 0) {
+			select_write_group(out, group);
+		} else if (select_group_value(group, sel->field, buf,
+					      &value)) {
+			select_write_value(out, style, &value);
+		}
+	}
+
+	return out->error;
+}
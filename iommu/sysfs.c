@@ -6,7 +6,6 @@
 #define _GNU_SOURCE
 #include <dirent.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -18,42 +17,19 @@
 #include "iommu.h"
 #include "pci.h"
 #include "string-buffer.h"
+#include "sysfs-file.h"
 
 #define SYSFS_PCI_DEVICES "/sys/bus/pci/devices"
+#define SYSFS_IOMMU_GROUPS "/sys/kernel/iommu_groups"
 
-static ssize_t sysfs_read_file(const char *path, char *buf, size_t size)
+static int iommu_read_pci_device(const struct iommu_read_options *opts,
+				 struct iommu_groups *list,
+				 const char *dev_path, struct pci_device *dev)
 {
-	int fd = open(path, O_RDONLY);
-	ssize_t len;
-	int errno_tmp;
-
-	if (fd < 0)
-		return -errno;
-
-	len = read(fd, buf, size - 1);
-	errno_tmp = errno;
-	close(fd);
-
-	if (len < 0)
-		return -errno_tmp;
-
-	buf[len] = '\0';
-
-	if (len > 0 && buf[len - 1] == '\n') {
-		buf[len - 1] = '\0';
-		len--;
-	}
-
-	return len;
-}
-
-static int iommu_read_pci_device(const char *dev_path, struct pci_device *dev)
-{
-	STRING_BUFFER(buf, PATH_MAX);
 	const char *bdf;
 	ssize_t ret;
 
-	dev->valid = false;
+	memset(dev, 0, sizeof(*dev));
 
 	bdf = strrchr(dev_path, '/');
 	if (bdf)
@@ -65,62 +41,59 @@ static int iommu_read_pci_device(const char *dev_path, struct pci_device *dev)
 	if (ret)
 		return ret;
 
-	string_buffer_append(buf, dev_path);
-	string_buffer_append(buf, "/vendor");
-	ret = sysfs_read_file((const char *)buf->data, dev->vendor,
+	if (iommu_read_virtfn(list, dev_path, dev) == 0)
+		goto out;
+
+	ret = sysfs_read_attr(dev_path, "vendor", dev->vendor,
 			      sizeof(dev->vendor));
 	if (ret < 0)
 		return ret;
 
-	string_buffer_clear(buf);
-	string_buffer_append(buf, dev_path);
-	string_buffer_append(buf, "/device");
-	ret = sysfs_read_file((const char *)buf->data, dev->device,
+	ret = sysfs_read_attr(dev_path, "device", dev->device,
 			      sizeof(dev->device));
 	if (ret < 0)
 		return ret;
 
-	string_buffer_clear(buf);
-	string_buffer_append(buf, dev_path);
-	string_buffer_append(buf, "/class");
-	ret = sysfs_read_file((const char *)buf->data, dev->class,
+	ret = sysfs_read_attr(dev_path, "class", dev->class,
 			      sizeof(dev->class));
 	if (ret < 0)
 		return ret;
 
-	string_buffer_clear(buf);
-	string_buffer_append(buf, dev_path);
-	string_buffer_append(buf, "/revision");
-	dev->has_revision =
-		sysfs_read_file((const char *)buf->data, dev->revision,
-				sizeof(dev->revision)) >= 0;
+	dev->has_revision = sysfs_read_attr(dev_path, "revision",
+					    dev->revision,
+					    sizeof(dev->revision)) >= 0;
+
+out:
+	iommu_read_device_extras(opts, dev_path, dev);
 
 	dev->valid = true;
 	return 0;
 }
 
-bool iommu_groups_read(struct iommu_group *groups, unsigned int *cnt,
-		       unsigned int capacity)
+static bool iommu_sysfs_available(void)
+{
+	return access(SYSFS_PCI_DEVICES, R_OK | X_OK) == 0;
+}
+
+static bool iommu_sysfs_read(const struct iommu_read_options *opts,
+			     struct iommu_groups *list)
 {
 	STRING_BUFFER(buf, PATH_MAX);
 	struct iommu_group *target;
-	struct pci_device *pci_dev;
+	struct pci_device pci_dev;
 	char target_path[PATH_MAX];
 	struct dirent *entry;
-	unsigned int i;
 	char *endptr;
 	ssize_t len;
 	DIR *dir;
 	long id;
 
-	*cnt = 0;
-
 	dir = opendir(SYSFS_PCI_DEVICES);
 	if (!dir)
 		return false;
 
-	errno = 0;
 	for (;;) {
+		errno = 0;
 		entry = readdir(dir);
 		if (!entry)
 			break;
@@ -149,29 +122,6 @@ bool iommu_groups_read(struct iommu_group *groups, unsigned int *cnt,
 		if (errno != 0 || *endptr != '\0' || id < 0)
 			continue;
 
-		target = NULL;
-		for (i = 0; i < *cnt; i++) {
-			if (groups[i].group_id == id) {
-				target = &groups[i];
-				break;
-			}
-		}
-
-		if (!target) {
-			if (*cnt >= capacity)
-				goto err;
-
-			target = &groups[*cnt];
-			target->group_id = (unsigned int)id;
-			target->nr_devices = 0;
-			(*cnt)++;
-		}
-
-		if (target->nr_devices >= IOMMU_GROUP_NR_DEVICES)
-			goto err;
-
-		pci_dev = &target->devices[target->nr_devices];
-
 		string_buffer_clear(buf);
 		string_buffer_append(buf, SYSFS_PCI_DEVICES);
 		string_buffer_append(buf, "/");
@@ -180,20 +130,122 @@ bool iommu_groups_read(struct iommu_group *groups, unsigned int *cnt,
 		if (buf->status & STRING_BUFFER_OVERFLOW)
 			continue;
 
-		if (iommu_read_pci_device((const char *)buf->data, pci_dev) < 0)
+		if (iommu_read_pci_device(opts, list, (const char *)buf->data,
+					  &pci_dev) < 0)
 			continue;
 
-		target->nr_devices++;
+		target = iommu_groups_get(list, (unsigned int)id);
+		if (!target || !iommu_group_add_device(target, &pci_dev))
+			goto err;
 	}
 
 	if (errno)
 		goto err;
 
 	closedir(dir);
-	iommu_groups_sort(groups, *cnt);
 	return true;
 
 err:
 	closedir(dir);
 	return false;
 }
+
+static DIR *iommu_group_devices_open(unsigned int group_id)
+{
+	char path[sizeof(SYSFS_IOMMU_GROUPS) + 32];
+
+	snprintf(path, sizeof(path), "%s/%u/devices", SYSFS_IOMMU_GROUPS,
+		 group_id);
+	return opendir(path);
+}
+
+/* Returns the number of PCI devices read, or a negative error. */
+static int iommu_sysfs_read_group(const struct iommu_read_options *opts,
+				  unsigned int group_id,
+				  struct iommu_groups *list)
+{
+	STRING_BUFFER(buf, PATH_MAX);
+	struct iommu_group *target = NULL;
+	struct pci_device pci_dev;
+	struct dirent *entry;
+	int nr = 0;
+	DIR *dir;
+
+	dir = iommu_group_devices_open(group_id);
+	if (!dir)
+		return 0;
+
+	for (;;) {
+		errno = 0;
+		entry = readdir(dir);
+		if (!entry) {
+			if (errno)
+				nr = -errno;
+			break;
+		}
+
+		if (entry->d_name[0] == '.')
+			continue;
+
+		string_buffer_clear(buf);
+		string_buffer_append(buf, SYSFS_PCI_DEVICES "/");
+		string_buffer_append(buf, entry->d_name);
+
+		if (buf->status & STRING_BUFFER_OVERFLOW)
+			continue;
+
+		if (iommu_read_pci_device(opts, list, (const char *)buf->data,
+					  &pci_dev) < 0)
+			continue;
+
+		if (!target)
+			target = iommu_groups_get(list, group_id);
+		if (!target || !iommu_group_add_device(target, &pci_dev)) {
+			nr = -ENOMEM;
+			break;
+		}
+
+		nr++;
+	}
+
+	closedir(dir);
+	return nr;
+}
+
+/*
+ * Reads the selected groups in the order of their IDs from their
+ * /sys/kernel/iommu_groups/<id>/devices directories, and stops at the
+ * limit, so that the cost depends on the number of groups listed.
+ */
+static bool iommu_sysfs_read_groups(const struct iommu_read_options *opts,
+				    struct iommu_groups *list)
+{
+	unsigned int *ids;
+	bool ret = true;
+	int i, nr;
+
+	nr = iommu_group_ids_read(opts, &ids);
+	if (nr < 0)
+		return false;
+
+	for (i = 0; i < nr; i++) {
+		if ((opts->flags & IOMMU_READ_LIMIT) &&
+		    list->nr_groups == opts->limit)
+			break;
+
+		if (iommu_sysfs_read_group(opts, ids[i], list) < 0) {
+			ret = false;
+			break;
+		}
+	}
+
+	free(ids);
+	return ret;
+}
+
+const struct iommu_backend iommu_sysfs_backend = {
+	.name = "sysfs",
+	.available = iommu_sysfs_available,
+	.read = iommu_sysfs_read,
+	.read_groups = iommu_sysfs_read_groups,
+};
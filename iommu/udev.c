@@ -4,11 +4,11 @@
  */
 
 #define _GNU_SOURCE
+#include <dlfcn.h>
 #include <errno.h>
-#include <libgen.h>
-#include <libudev.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,35 +16,108 @@
 
 #include "iommu.h"
 #include "pci.h"
-#include "string-buffer.h"
+#include "sysfs-file.h"
 
-static bool iommu_group_id(struct udev_device *dev, unsigned int *id)
+#define LIBUDEV_SONAME "libudev.so.1"
+
+/*
+ * libudev is loaded with dlopen() only when the udev backend is selected,
+ * so that the other backends do not pay for loading and initializing it.
+ * It is used only for enumeration, and the attributes are read from the
+ * enumerated syspaths without creating a udev_device for each of them.
+ */
+struct udev;
+struct udev_enumerate;
+struct udev_list_entry;
+
+struct libudev_ops {
+	void *handle;
+	bool failed;
+	struct udev *(*new)(void);
+	struct udev *(*unref)(struct udev *udev);
+	struct udev_enumerate *(*enumerate_new)(struct udev *udev);
+	struct udev_enumerate *(*enumerate_unref)(struct udev_enumerate *e);
+	int (*enumerate_add_match_subsystem)(struct udev_enumerate *e,
+					     const char *subsystem);
+	int (*enumerate_scan_devices)(struct udev_enumerate *e);
+	struct udev_list_entry *(*enumerate_get_list_entry)(
+		struct udev_enumerate *e);
+	struct udev_list_entry *(*list_entry_get_next)(
+		struct udev_list_entry *entry);
+	const char *(*list_entry_get_name)(struct udev_list_entry *entry);
+};
+
+static struct libudev_ops libudev;
+
+#define LIBUDEV_SYMBOL(field, symbol) \
+	{ offsetof(struct libudev_ops, field), symbol }
+
+static const struct {
+	size_t offset;
+	const char *name;
+} libudev_symbols[] = {
+	LIBUDEV_SYMBOL(new, "udev_new"),
+	LIBUDEV_SYMBOL(unref, "udev_unref"),
+	LIBUDEV_SYMBOL(enumerate_new, "udev_enumerate_new"),
+	LIBUDEV_SYMBOL(enumerate_unref, "udev_enumerate_unref"),
+	LIBUDEV_SYMBOL(enumerate_add_match_subsystem,
+		       "udev_enumerate_add_match_subsystem"),
+	LIBUDEV_SYMBOL(enumerate_scan_devices, "udev_enumerate_scan_devices"),
+	LIBUDEV_SYMBOL(enumerate_get_list_entry,
+		       "udev_enumerate_get_list_entry"),
+	LIBUDEV_SYMBOL(list_entry_get_next, "udev_list_entry_get_next"),
+	LIBUDEV_SYMBOL(list_entry_get_name, "udev_list_entry_get_name"),
+};
+
+static bool libudev_load(void)
 {
-	STRING_BUFFER(path_buf, 512);
-	const char *sysfs_path;
-	char target[512];
-	long parsed_id;
-	char *endptr;
-	ssize_t len;
+	void *sym;
+	size_t i;
+
+	if (libudev.handle)
+		return true;
 
-	sysfs_path = udev_device_get_syspath(dev);
-	if (!sysfs_path)
+	if (libudev.failed)
 		return false;
 
-	string_buffer_append(path_buf, sysfs_path);
-	string_buffer_append(path_buf, "/iommu_group");
+	libudev.handle = dlopen(LIBUDEV_SONAME, RTLD_NOW | RTLD_LOCAL);
+	if (!libudev.handle)
+		goto err;
 
-	if (path_buf->status & STRING_BUFFER_OVERFLOW)
-		return false;
+	for (i = 0; i < sizeof(libudev_symbols) / sizeof(libudev_symbols[0]);
+	     i++) {
+		sym = dlsym(libudev.handle, libudev_symbols[i].name);
+		if (!sym)
+			goto err;
 
-	len = readlink((const char *)path_buf->data, target, sizeof(target) - 1);
-	if (len < 0)
-		return false;
+		/* ISO C has no cast from void * to a function pointer. */
+		memcpy((char *)&libudev + libudev_symbols[i].offset, &sym,
+		       sizeof(sym));
+	}
+
+	return true;
 
-	target[len] = '\0';
+err:
+	if (libudev.handle)
+		dlclose(libudev.handle);
+
+	libudev.handle = NULL;
+	libudev.failed = true;
+	return false;
+}
+
+static bool iommu_group_id(const char *syspath, unsigned int *id)
+{
+	char name[16];
+	long parsed_id;
+	char *endptr;
+
+	if (sysfs_read_link_name(syspath, "iommu_group", name,
+				 sizeof(name)) < 0)
+		return false;
 
 	errno = 0;
-	parsed_id = strtol(basename(target), &endptr, 10);
+	parsed_id = strtol(name, &endptr, 10);
 	if (errno == ERANGE || *endptr != '\0' || parsed_id < 0)
 		return false;
 
@@ -52,145 +125,109 @@ static bool iommu_group_id(struct udev_device *dev, unsigned int *id)
 	return true;
 }
 
-static int iommu_read_pci_device(struct udev_device *dev,
-				 struct pci_device *pci_dev)
+/*
+ * A device whose core attributes cannot be read is still listed, but
+ * without them.
+ */
+static void iommu_read_pci_device(const struct iommu_read_options *opts,
+				  struct iommu_groups *list,
+				  const char *syspath,
+				  struct pci_device *pci_dev)
 {
-	const char *revision, *vendor, *device, *class, *sysname;
-	int ret;
-
-	pci_dev->valid = false;
+	const char *sysname;
 
-	sysname = udev_device_get_sysname(dev);
-	if (!sysname)
-		return -EINVAL;
+	memset(pci_dev, 0, sizeof(*pci_dev));
 
-	ret = pci_string_to_addr(sysname, &pci_dev->addr);
-	if (ret)
-		return ret;
+	sysname = strrchr(syspath, '/');
+	sysname = sysname ? sysname + 1 : syspath;
 
-	vendor = udev_device_get_sysattr_value(dev, "vendor");
-	device = udev_device_get_sysattr_value(dev, "device");
-	class = udev_device_get_sysattr_value(dev, "class");
-	revision = udev_device_get_sysattr_value(dev, "revision");
+	if (pci_string_to_addr(sysname, &pci_dev->addr))
+		return;
 
-	if (!vendor || !device || !class)
-		return 0;
+	if (iommu_read_virtfn(list, syspath, pci_dev) == 0)
+		goto out;
 
-	strncpy(pci_dev->vendor, vendor, sizeof(pci_dev->vendor));
-	pci_dev->vendor[sizeof(pci_dev->vendor) - 1] = '\0';
+	if (sysfs_read_attr(syspath, "vendor", pci_dev->vendor,
+			    sizeof(pci_dev->vendor)) < 0 ||
+	    sysfs_read_attr(syspath, "device", pci_dev->device,
+			    sizeof(pci_dev->device)) < 0 ||
+	    sysfs_read_attr(syspath, "class", pci_dev->class,
+			    sizeof(pci_dev->class)) < 0)
+		return;
 
-	strncpy(pci_dev->device, device, sizeof(pci_dev->device));
-	pci_dev->device[sizeof(pci_dev->device) - 1] = '\0';
+	pci_dev->has_revision = sysfs_read_attr(syspath, "revision",
+						pci_dev->revision,
+						sizeof(pci_dev->revision)) >= 0;
 
-	strncpy(pci_dev->class, class, sizeof(pci_dev->class));
-	pci_dev->class[sizeof(pci_dev->class) - 1] = '\0';
-
-	if (revision) {
-		pci_dev->has_revision = true;
-		strncpy(pci_dev->revision, revision, sizeof(pci_dev->revision));
-		pci_dev->revision[sizeof(pci_dev->revision) - 1] = '\0';
-	} else {
-		pci_dev->has_revision = false;
-	}
+out:
+	iommu_read_device_extras(opts, syspath, pci_dev);
 
 	pci_dev->valid = true;
-	return 0;
 }
 
-static bool iommu_get_group(struct udev *udev,
+static bool iommu_get_group(const struct iommu_read_options *opts,
 			    struct udev_list_entry *dev_list_entry,
-			    struct iommu_group *groups, unsigned int *groups_cnt,
-			    unsigned int groups_size)
+			    struct iommu_groups *list)
 {
-	struct pci_device *pci_dev;
 	struct iommu_group *target;
-	struct udev_device *dev;
+	struct pci_device pci_dev;
 	unsigned int group_id;
-	const char *path;
-	unsigned int i;
-
-	path = udev_list_entry_get_name(dev_list_entry);
-	dev = udev_device_new_from_syspath(udev, path);
-	if (!dev)
-		return true;
+	const char *syspath;
 
-	if (!iommu_group_id(dev, &group_id)) {
-		udev_device_unref(dev);
+	syspath = libudev.list_entry_get_name(dev_list_entry);
+	if (!syspath || !iommu_group_id(syspath, &group_id) ||
+	    !iommu_read_wants_group(opts, group_id))
 		return true;
-	}
-
-	target = NULL;
-	for (i = 0; i < *groups_cnt; i++) {
-		if (groups[i].group_id == group_id) {
-			target = &groups[i];
-			break;
-		}
-	}
-
-	if (!target) {
-		if (*groups_cnt >= groups_size) {
-			udev_device_unref(dev);
-			return false;
-		}
 
-		target = &groups[*groups_cnt];
-		target->group_id = group_id;
-		target->nr_devices = 0;
-		(*groups_cnt)++;
-	}
-
-	if (target->nr_devices >= IOMMU_GROUP_NR_DEVICES) {
-		udev_device_unref(dev);
-		return false;
-	}
-
-	pci_dev = &target->devices[target->nr_devices];
-	iommu_read_pci_device(dev, pci_dev);
+	iommu_read_pci_device(opts, list, syspath, &pci_dev);
 
-	target->nr_devices++;
-	udev_device_unref(dev);
+	target = iommu_groups_get(list, group_id);
+	return target && iommu_group_add_device(target, &pci_dev);
+}
 
-	return true;
+static bool iommu_udev_available(void)
+{
+	return libudev_load();
 }
 
-bool iommu_groups_read(struct iommu_group *groups, unsigned int *cnt,
-		       unsigned int capacity)
+static bool iommu_udev_read(const struct iommu_read_options *opts,
+			    struct iommu_groups *list)
 {
 	struct udev *udev;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *dev_list_entry;
 	bool ret = true;
 
-	*cnt = 0;
-
-	udev = udev_new();
+	udev = libudev.new();
 	if (!udev)
 		return false;
 
-	enumerate = udev_enumerate_new(udev);
+	enumerate = libudev.enumerate_new(udev);
 	if (!enumerate) {
-		udev_unref(udev);
+		libudev.unref(udev);
 		return false;
 	}
 
-	udev_enumerate_add_match_subsystem(enumerate, "pci");
-	udev_enumerate_scan_devices(enumerate);
-	devices = udev_enumerate_get_list_entry(enumerate);
+	libudev.enumerate_add_match_subsystem(enumerate, "pci");
+	libudev.enumerate_scan_devices(enumerate);
+	devices = libudev.enumerate_get_list_entry(enumerate);
 
-	udev_list_entry_foreach(dev_list_entry, devices)
-	{
-		if (!iommu_get_group(udev, dev_list_entry, groups, cnt,
-				     capacity)) {
+	for (dev_list_entry = devices; dev_list_entry;
+	     dev_list_entry = libudev.list_entry_get_next(dev_list_entry)) {
+		if (!iommu_get_group(opts, dev_list_entry, list)) {
 			ret = false;
 			break;
 		}
 	}
 
-	if (ret)
-		iommu_groups_sort(groups, *cnt);
-
-	udev_enumerate_unref(enumerate);
-	udev_unref(udev);
+	libudev.enumerate_unref(enumerate);
+	libudev.unref(udev);
 
 	return ret;
 }
+
+const struct iommu_backend iommu_udev_backend = {
+	.name = "udev",
+	.available = iommu_udev_available,
+	.read = iommu_udev_read,
+};
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iommu.h"
+#include "pci.h"
+
+#define PCI_CLASS_BRIDGE_HOST 0x0600
+#define PCI_CLASS_BRIDGE_ISA 0x0601
+#define PCI_CLASS_BRIDGE_PCI 0x0604
+#define PCI_CLASS_SERIAL_SMBUS 0x0c05
+
+static const char *const iommu_vfio_state_names[] = {
+	[IOMMU_VFIO_UNKNOWN] = "unknown",
+	[IOMMU_VFIO_BOUND] = "vfio",
+	[IOMMU_VFIO_BINDABLE] = "bindable",
+	[IOMMU_VFIO_NO_ENDPOINTS] = "no-endpoints",
+	[IOMMU_VFIO_HOST_CRITICAL] = "host-critical",
+};
+
+const char *iommu_vfio_state_name(enum iommu_vfio_state state)
+{
+	return iommu_vfio_state_names[state];
+}
+
+enum iommu_vfio_state iommu_vfio_state_from_name(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(iommu_vfio_state_names) /
+				sizeof(iommu_vfio_state_names[0]);
+	     i++)
+		if (strcmp(iommu_vfio_state_names[i], name) == 0)
+			return i;
+
+	return IOMMU_VFIO_UNKNOWN;
+}
+
+static uint32_t pci_device_class(const struct pci_device *dev)
+{
+	uint32_t class;
+
+	if (pci_property_to_u32(dev->class, &class) < 0)
+		return 0;
+
+	return class >> 8;
+}
+
+static bool pci_device_is_bridge(const struct pci_device *dev)
+{
+	const struct pci_binding *binding = &dev->binding;
+
+	if (binding->flags & PCI_BINDING_HEADER)
+		return (binding->header_type & PCI_HEADER_TYPE_MASK) !=
+		       PCI_HEADER_TYPE_NORMAL;
+
+	return pci_device_class(dev) == PCI_CLASS_BRIDGE_PCI;
+}
+
+static bool pci_device_is_host_critical(const struct pci_device *dev)
+{
+	switch (pci_device_class(dev)) {
+	case PCI_CLASS_BRIDGE_HOST:
+	case PCI_CLASS_BRIDGE_ISA:
+	case PCI_CLASS_SERIAL_SMBUS:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * The kernel allows a group to be used through VFIO when its endpoints are
+ * bound to vfio-pci. Bridges may stay with pcieport or without a driver.
+ */
+static enum iommu_vfio_state iommu_group_vfio_state(struct iommu_group *group)
+{
+	unsigned int nr_endpoints = 0;
+	unsigned int nr_bound = 0;
+	struct pci_device *dev;
+	unsigned int i;
+
+	for (i = 0; i < group->nr_devices; i++) {
+		dev = &group->devices[i];
+
+		if (!dev->valid || !(dev->binding.flags & PCI_BINDING_DRIVER))
+			return IOMMU_VFIO_UNKNOWN;
+
+		if (pci_device_is_host_critical(dev))
+			return IOMMU_VFIO_HOST_CRITICAL;
+
+		if (pci_device_is_bridge(dev))
+			continue;
+
+		nr_endpoints++;
+		if (strcmp(dev->binding.driver, "vfio-pci") == 0)
+			nr_bound++;
+	}
+
+	if (nr_endpoints == 0)
+		return IOMMU_VFIO_NO_ENDPOINTS;
+
+	if (nr_bound == nr_endpoints)
+		return IOMMU_VFIO_BOUND;
+
+	return IOMMU_VFIO_BINDABLE;
+}
+
+void iommu_groups_vfio_state(struct iommu_group *groups, unsigned int nr_groups)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_groups; i++)
+		groups[i].vfio = iommu_group_vfio_state(&groups[i]);
+}
@@ -3,88 +3,500 @@
  * Copyright(c) Opinsys Oy 2025
  */
 
+#define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "iommu.h"
-#include "pci.h"
-#include "string-buffer.h"
-
-#define _QUOTE(str) #str
-#define QUOTE(str) _QUOTE(str)
-
-static const size_t IOMMU_NR_GROUPS = 256;
-
-static int print_plain(struct iommu_group *groups, unsigned int nr_groups)
-{
-	STRING_BUFFER(buf, 512);
-	struct pci_device *dev;
-	char addr_str[32];
-	unsigned int i, j;
-
-	for (i = 0; i < nr_groups; i++) {
-		for (j = 0; j < groups[i].nr_devices; j++) {
-			dev = &groups[i].devices[j];
-
-			if (dev->valid) {
-				string_buffer_to_pci(buf, dev);
-				printf("Group %03u %s\n", groups[i].group_id,
-				       (char *)buf->data);
-			} else {
-				pci_addr_to_string(dev->addr, addr_str,
-						   sizeof(addr_str));
-				printf("Group %03u %s N/A\n",
-				       groups[i].group_id, addr_str);
-			}
+#include "output.h"
+
+#define MAX_OUTPUTS 16
+
+/* An --output option: a format and a file, or "-" for standard output. */
+struct output_spec {
+	const struct iommu_emitter *emitter;
+	const char *path;
+};
+
+static uint8_t output_buffer[OUTPUT_BUFFER_SIZE];
+
+/* Threads set with --jobs, where 0 selects the default of each mode. */
+static unsigned int nr_jobs;
+
+static int print_groups(const struct iommu_emitter *emitter, int fd,
+			const struct iommu_groups *list)
+{
+	struct output out;
+	int ret;
+
+	if (nr_jobs > 1)
+		return iommu_emit_parallel(emitter, fd, list, nr_jobs);
+
+	output_init(&out, fd, output_buffer, sizeof(output_buffer));
+
+	ret = iommu_emit(emitter, &out, list);
+	if (ret)
+		return ret;
+
+	return output_flush(&out);
+}
+
+/*
+ * Writes a file into a temporary file in the same directory, which is then
+ * renamed over @spec->path, so that readers never see a partial file.
+ */
+static int write_output(const struct output_spec *spec, mode_t mode,
+			const struct iommu_groups *list)
+{
+	char tmp_path[PATH_MAX];
+	int ret, fd;
+
+	if (strcmp(spec->path, "-") == 0)
+		return print_groups(spec->emitter, STDOUT_FILENO, list);
+
+	ret = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", spec->path);
+	if (ret < 0 || (size_t)ret >= sizeof(tmp_path))
+		return -ENAMETOOLONG;
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0)
+		return -errno;
+
+	ret = print_groups(spec->emitter, fd, list);
+	if (!ret && fchmod(fd, mode) < 0)
+		ret = -errno;
+	if (close(fd) < 0 && !ret)
+		ret = -errno;
+	if (!ret && rename(tmp_path, spec->path) < 0)
+		ret = -errno;
+	if (ret)
+		unlink(tmp_path);
+
+	return ret;
+}
+
+/* Every output is attempted even if an earlier one failed. */
+static int write_outputs(const struct output_spec *outputs,
+			 unsigned int nr_outputs,
+			 const struct iommu_groups *list)
+{
+	unsigned int i;
+	int ret = 0, err;
+	mode_t mode;
+
+	mode = umask(0);
+	umask(mode);
+	mode = 0666 & ~mode;
 
-			string_buffer_clear(buf);
+	for (i = 0; i < nr_outputs; i++) {
+		err = write_output(&outputs[i], mode, list);
+		if (err) {
+			fprintf(stderr, "error: cannot write '%s': %s\n",
+				outputs[i].path, strerror(-err));
+			ret = err;
 		}
 	}
 
+	return ret;
+}
+
+/* With --output, the format of standard output is not used. */
+static bool emits_fingerprint(const struct iommu_emitter *emitter,
+			      const struct output_spec *outputs,
+			      unsigned int nr_outputs)
+{
+	unsigned int i;
+
+	if (!nr_outputs)
+		return emitter->fingerprint;
+
+	for (i = 0; i < nr_outputs; i++)
+		if (outputs[i].emitter->fingerprint)
+			return true;
+
+	return false;
+}
+
+static int parse_output(const char *str, struct output_spec *spec)
+{
+	char format[16];
+	const char *eq;
+
+	eq = strchr(str, '=');
+	if (!eq || eq == str || eq[1] == '\0' ||
+	    (size_t)(eq - str) >= sizeof(format))
+		return -EINVAL;
+
+	memcpy(format, str, eq - str);
+	format[eq - str] = '\0';
+
+	spec->emitter = iommu_emitter_find(format);
+	if (!spec->emitter)
+		return -EINVAL;
+
+	spec->path = eq + 1;
 	return 0;
 }
 
-static int print_json(struct iommu_group *groups, unsigned int nr_groups)
+static int print_fingerprint(const struct iommu_groups *list)
+{
+	struct output out;
+
+	output_init(&out, STDOUT_FILENO, output_buffer, sizeof(output_buffer));
+	output_hex(&out, list->fingerprint >> 32, 8);
+	output_hex(&out, list->fingerprint, 8);
+	output_char(&out, '\n');
+
+	return output_flush(&out);
+}
+
+static int load_groups(const char *path, struct iommu_groups *list)
 {
-	const struct string_buffer *json_buf = iommu_to_json(groups, nr_groups);
+	int ret, fd;
 
-	if (!json_buf)
-		return -ENOMEM;
+	if (strcmp(path, "-") == 0)
+		return iommu_groups_load(STDIN_FILENO, list);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	ret = iommu_groups_load(fd, list);
+	close(fd);
+	return ret;
+}
+
+static int record_style(const char *format, enum iommu_record_style *style)
+{
+	if (strcmp(format, "plain") == 0)
+		*style = IOMMU_RECORD_PLAIN;
+	else if (strcmp(format, "json") == 0)
+		*style = IOMMU_RECORD_JSON;
+	else if (strcmp(format, "ndjson") == 0)
+		*style = IOMMU_RECORD_NDJSON;
+	else
+		return -EINVAL;
 
-	printf("%s\n", (char *)json_buf->data);
 	return 0;
 }
 
+static int print_diff(enum iommu_record_style style,
+		      const struct iommu_groups *old,
+		      const struct iommu_groups *new)
+{
+	struct output out;
+	int ret;
+
+	output_init(&out, STDOUT_FILENO, output_buffer, sizeof(output_buffer));
+
+	ret = iommu_diff(&out, style, old, new);
+	if (ret < 0)
+		return ret;
+
+	if (output_flush(&out) < 0)
+		return out.error;
+
+	return ret;
+}
+
+static int print_collisions(enum iommu_record_style style,
+			    const struct iommu_group *groups,
+			    unsigned int nr_groups, uint64_t start,
+			    uint64_t end)
+{
+	struct iommu_region_index index;
+	struct output out;
+	int ret;
+
+	ret = iommu_region_index_build(&index, groups, nr_groups);
+	if (ret)
+		return ret;
+
+	output_init(&out, STDOUT_FILENO, output_buffer, sizeof(output_buffer));
+
+	ret = iommu_check_range(&out, style, &index, start, end);
+	if (ret >= 0 && output_flush(&out) < 0)
+		ret = out.error;
+
+	iommu_region_index_free(&index);
+	return ret;
+}
+
+static int print_selection(enum iommu_record_style style,
+			   const struct iommu_selector *sel,
+			   struct iommu_group *groups, unsigned int nr_groups)
+{
+	struct output out;
+	int ret;
+
+	output_init(&out, STDOUT_FILENO, output_buffer, sizeof(output_buffer));
+
+	ret = iommu_select(&out, style, sel, groups, nr_groups);
+	if (ret)
+		return ret;
+
+	return output_flush(&out);
+}
+
+static int aggregate(const char *dir, enum iommu_record_style style,
+		     const struct iommu_query *query)
+{
+	struct iommu_fleet fleet = { 0 };
+	struct output out;
+	unsigned int i;
+	int ret;
+
+	ret = iommu_fleet_load(&fleet, dir, nr_jobs);
+	if (ret) {
+		fprintf(stderr, "error: cannot load '%s': %s\n", dir,
+			strerror(-ret));
+		goto out;
+	}
+
+	for (i = 0; i < fleet.nr_hosts; i++)
+		if (fleet.hosts[i].error)
+			fprintf(stderr, "warning: skipping host '%s': %s\n",
+				fleet.hosts[i].name,
+				strerror(-fleet.hosts[i].error));
+
+	output_init(&out, STDOUT_FILENO, output_buffer, sizeof(output_buffer));
+
+	ret = iommu_fleet_query(&out, style, &fleet, query);
+	if (ret >= 0)
+		ret = output_flush(&out);
+	if (ret)
+		fprintf(stderr, "print error: %s\n", strerror(-ret));
+
+out:
+	iommu_fleet_free(&fleet);
+	return ret;
+}
+
 static void print_usage(const char *name)
 {
-	printf("Usage: %s [-h] [--format <format>]\n", name);
-	printf("Lists IOMMU groups and their associated PCI devices.\n");
-	printf("This version was compiled for %s discovery.\n\n",
-	       QUOTE(CONFIG_DISCOVERY));
+	printf("Usage: %s [options]\n", name);
+	printf("Lists IOMMU groups and their associated PCI devices.\n\n");
 	printf("  -h, --help            Print help and exit\n");
-	printf("      --format <format> Output format (plain|json), default: plain\n");
+	printf("      --format <format> Output format (plain|json|ndjson|cbor),\n");
+	printf("                        default: plain\n");
+	printf("      --output <format>=<file>\n");
+	printf("                        Write the groups to a file, or to\n");
+	printf("                        standard output with '-', instead;\n");
+	printf("                        can be repeated\n");
+	printf("      --jobs <n>        Threads for formatting, default: 1,\n");
+	printf("                        and for --aggregate, default: CPUs\n");
+	printf("      --backend <backend>\n");
+	printf("                        Discovery backend (auto|sysfs|udev),\n");
+	printf("                        default: auto\n");
+	printf("      --group <id>[-<last>]\n");
+	printf("                        Only list the group or the range of\n");
+	printf("                        groups\n");
+	printf("      --limit <n>       Only list the first n groups\n");
+	printf("      --locality        Read NUMA node, local CPUs and PCIe link\n");
+	printf("      --numa <node>     Only list groups with a device on the\n");
+	printf("                        NUMA node, implies --locality\n");
+	printf("      --vfio            Read drivers and report the VFIO\n");
+	printf("                        readiness of each group\n");
+	printf("      --regions         Read the reserved regions of each group\n");
+	printf("      --acs             Read the ACS registers of each device\n");
+	printf("                        and the bridges above each group\n");
+	printf("      --check-range <start>-<end>\n");
+	printf("                        Print the reserved regions that overlap\n");
+	printf("                        the range, implies --regions\n");
+	printf("      --fingerprint     Print only a hash of the topology\n");
+	printf("      --select <expr>   Print the fields or objects selected\n");
+	printf("                        by a path such as\n");
+	printf("                        'group.devices[class=03*].address'\n");
+	printf("      --diff <file>     Compare against a json or ndjson\n");
+	printf("                        snapshot, '-' reads standard input\n");
+	printf("      --aggregate <dir> List devices from the json or ndjson\n");
+	printf("                        snapshots of many hosts in a directory\n");
+	printf("      --match <vendor:device>\n");
+	printf("                        Only list devices with the IDs\n");
+	printf("      --class <class>   Only list devices with a class that\n");
+	printf("                        starts with 2, 4 or 6 hex digits\n");
+	printf("      --shared          Only list devices in a shared group\n");
+}
+
+static int parse_int(const char *str, int *value)
+{
+	char *endptr;
+	long ret;
+
+	errno = 0;
+	ret = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || ret < INT_MIN ||
+	    ret > INT_MAX)
+		return -EINVAL;
+
+	*value = ret;
+	return 0;
+}
+
+static int parse_hex(const char *str, size_t len, uint32_t *value)
+{
+	uint32_t acc = 0;
+	size_t i;
+	char c;
+
+	for (i = 0; i < len; i++) {
+		c = str[i];
+		if (c >= '0' && c <= '9')
+			acc = acc << 4 | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			acc = acc << 4 | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			acc = acc << 4 | (c - 'A' + 10);
+		else
+			return -EINVAL;
+	}
+
+	*value = acc;
+	return 0;
+}
+
+static int parse_match(const char *str, uint32_t *id)
+{
+	uint32_t vendor, device;
+
+	if (strlen(str) != 9 || str[4] != ':' || parse_hex(str, 4, &vendor) ||
+	    parse_hex(str + 5, 4, &device))
+		return -EINVAL;
+
+	*id = vendor << 16 | device;
+	return 0;
+}
+
+static int parse_group_id(const char *str, char **endptr, unsigned int *id)
+{
+	unsigned long value;
+
+	if (*str < '0' || *str > '9')
+		return -EINVAL;
+
+	errno = 0;
+	value = strtoul(str, endptr, 10);
+	if (errno || value > UINT_MAX)
+		return -EINVAL;
+
+	*id = value;
+	return 0;
+}
+
+/* Parses "<id>" or "<first>-<last>" into an inclusive range of groups. */
+static int parse_groups(const char *str, struct iommu_read_options *opts)
+{
+	char *endptr;
+
+	if (parse_group_id(str, &endptr, &opts->first_group) < 0)
+		return -EINVAL;
+
+	opts->last_group = opts->first_group;
+	if (*endptr == '-' &&
+	    parse_group_id(endptr + 1, &endptr, &opts->last_group) < 0)
+		return -EINVAL;
+
+	if (*endptr != '\0' || opts->last_group < opts->first_group)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* Parses "<start>-<end>", with inclusive bounds in hex or decimal. */
+static int parse_range(const char *str, uint64_t *start, uint64_t *end)
+{
+	char *endptr;
+
+	errno = 0;
+	*start = strtoull(str, &endptr, 0);
+	if (errno || endptr == str || *endptr != '-')
+		return -EINVAL;
+
+	str = endptr + 1;
+	*end = strtoull(str, &endptr, 0);
+	if (errno || endptr == str || *endptr != '\0' || *end < *start)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* A class prefix of 2, 4 or 6 digits selects a class, subclass or prog-if. */
+static int parse_class(const char *str, struct iommu_query *query)
+{
+	size_t len = strlen(str);
+	unsigned int shift;
+	uint32_t value;
+
+	if ((len != 2 && len != 4 && len != 6) || parse_hex(str, len, &value))
+		return -EINVAL;
+
+	shift = (6 - len) * 4;
+	query->class_first = value << shift;
+	query->class_last = query->class_first | ((1U << shift) - 1);
+	return 0;
 }
 
 int main(int argc, char **argv)
 {
 	const char *process_name = argv[0];
-	struct iommu_group *groups = NULL;
+	struct iommu_read_options read_opts = { 0 };
+	enum iommu_record_style style = IOMMU_RECORD_PLAIN;
+	const struct iommu_backend *backend;
+	const struct iommu_emitter *emitter;
+	struct iommu_groups baseline = { 0 };
+	const char *backend_name = "auto";
+	struct iommu_groups list = { 0 };
 	const char *format = "plain";
-	unsigned int nr_groups = 0;
+	struct output_spec outputs[MAX_OUTPUTS];
+	const char *aggregate_dir = NULL;
+	unsigned int nr_outputs = 0;
+	int jobs, limit;
+	struct iommu_selector selector;
+	const char *select = NULL;
+	struct iommu_query query = { 0 };
+	uint64_t range_start = 0, range_end = 0;
+	const char *diff_path = NULL;
+	const char *mode = NULL;
+	bool check_range = false;
+	bool fingerprint = false;
 	int ret, opt;
 
+	static const char short_options[] = "hs:o:j:b:g:L:ln:vrAR:d:fe:a:m:c:S";
 	static struct option long_options[] = {
 		{ "help", no_argument, 0, 'h' },
 		{ "format", required_argument, 0, 's' },
+		{ "output", required_argument, 0, 'o' },
+		{ "jobs", required_argument, 0, 'j' },
+		{ "backend", required_argument, 0, 'b' },
+		{ "group", required_argument, 0, 'g' },
+		{ "limit", required_argument, 0, 'L' },
+		{ "locality", no_argument, 0, 'l' },
+		{ "numa", required_argument, 0, 'n' },
+		{ "vfio", no_argument, 0, 'v' },
+		{ "diff", required_argument, 0, 'd' },
+		{ "regions", no_argument, 0, 'r' },
+		{ "acs", no_argument, 0, 'A' },
+		{ "check-range", required_argument, 0, 'R' },
+		{ "fingerprint", no_argument, 0, 'f' },
+		{ "select", required_argument, 0, 'e' },
+		{ "aggregate", required_argument, 0, 'a' },
+		{ "match", required_argument, 0, 'm' },
+		{ "class", required_argument, 0, 'c' },
+		{ "shared", no_argument, 0, 'S' },
 		{ 0, 0, 0, 0 }
 	};
 
 	for (;;) {
-		opt = getopt_long(argc, argv, "hs:", long_options, NULL);
+		opt = getopt_long(argc, argv, short_options, long_options,
+				  NULL);
 		if (opt == -1)
 			break;
 
@@ -95,44 +507,242 @@ int main(int argc, char **argv)
 		case 's':
 			format = optarg;
 			break;
+		case 'o':
+			if (nr_outputs == MAX_OUTPUTS ||
+			    parse_output(optarg, &outputs[nr_outputs]) < 0) {
+				fprintf(stderr, "error: invalid output '%s'\n",
+					optarg);
+				goto err;
+			}
+			nr_outputs++;
+			break;
+		case 'j':
+			if (parse_int(optarg, &jobs) < 0 || jobs < 1) {
+				fprintf(stderr, "error: invalid jobs '%s'\n",
+					optarg);
+				goto err;
+			}
+			nr_jobs = jobs;
+			break;
+		case 'b':
+			backend_name = optarg;
+			break;
+		case 'g':
+			if (parse_groups(optarg, &read_opts) < 0) {
+				fprintf(stderr, "error: invalid group '%s'\n",
+					optarg);
+				goto err;
+			}
+			read_opts.flags |= IOMMU_READ_GROUPS;
+			break;
+		case 'L':
+			if (parse_int(optarg, &limit) < 0 || limit < 1) {
+				fprintf(stderr, "error: invalid limit '%s'\n",
+					optarg);
+				goto err;
+			}
+			read_opts.limit = limit;
+			read_opts.flags |= IOMMU_READ_LIMIT;
+			break;
+		case 'l':
+			read_opts.flags |= IOMMU_READ_LOCALITY;
+			break;
+		case 'n':
+			if (parse_int(optarg, &read_opts.numa_node) < 0) {
+				fprintf(stderr, "error: invalid NUMA node '%s'\n",
+					optarg);
+				goto err;
+			}
+			read_opts.flags |= IOMMU_READ_LOCALITY |
+					   IOMMU_READ_NUMA_FILTER;
+			break;
+		case 'v':
+			read_opts.flags |= IOMMU_READ_VFIO;
+			break;
+		case 'r':
+			read_opts.flags |= IOMMU_READ_REGIONS;
+			break;
+		case 'A':
+			read_opts.flags |= IOMMU_READ_ACS;
+			break;
+		case 'R':
+			if (parse_range(optarg, &range_start, &range_end) < 0) {
+				fprintf(stderr, "error: invalid range '%s'\n",
+					optarg);
+				goto err;
+			}
+			read_opts.flags |= IOMMU_READ_REGIONS;
+			check_range = true;
+			break;
+		case 'd':
+			diff_path = optarg;
+			break;
+		case 'f':
+			fingerprint = true;
+			break;
+		case 'e':
+			if (iommu_selector_compile(optarg, &selector) < 0) {
+				fprintf(stderr, "error: invalid selector '%s'\n",
+					optarg);
+				goto err;
+			}
+			select = optarg;
+			break;
+		case 'a':
+			aggregate_dir = optarg;
+			break;
+		case 'm':
+			if (parse_match(optarg, &query.id) < 0) {
+				fprintf(stderr, "error: invalid IDs '%s'\n",
+					optarg);
+				goto err;
+			}
+			query.flags |= IOMMU_QUERY_ID;
+			break;
+		case 'c':
+			if (parse_class(optarg, &query) < 0) {
+				fprintf(stderr, "error: invalid class '%s'\n",
+					optarg);
+				goto err;
+			}
+			query.flags |= IOMMU_QUERY_CLASS;
+			break;
+		case 'S':
+			query.flags |= IOMMU_QUERY_SHARED;
+			break;
 		default:
 			goto err;
 		}
 	}
 
-	if (strcmp(format, "plain") && strcmp(format, "json")) {
+	emitter = iommu_emitter_find(format);
+	if (!emitter) {
 		fprintf(stderr, "error: invalid format '%s'\n", format);
 		goto err;
 	}
 
-	groups = calloc(IOMMU_NR_GROUPS, sizeof(struct iommu_group));
-	if (!groups) {
-		fprintf(stderr, "no memory\n");
+	/* Modes that write records instead of groups. */
+	mode = diff_path ? "diff" :
+	       aggregate_dir ? "aggregate" :
+	       select ? "select" :
+	       check_range ? "check-range" : NULL;
+
+	if (mode && record_style(format, &style) < 0) {
+		fprintf(stderr, "error: format '%s' does not support --%s\n",
+			format, mode);
+		goto err;
+	}
+
+	if (nr_outputs && (mode || fingerprint)) {
+		fprintf(stderr, "error: --output only writes group listings\n");
+		goto err;
+	}
+
+	if ((read_opts.flags & (IOMMU_READ_GROUPS | IOMMU_READ_LIMIT)) &&
+	    (diff_path || aggregate_dir)) {
+		fprintf(stderr, "error: --group and --limit do not apply to --%s\n",
+			mode);
+		goto err;
+	}
+
+	if (diff_path && ((read_opts.flags & IOMMU_READ_NUMA_FILTER) ||
+			  fingerprint || check_range)) {
+		fprintf(stderr, "error: --numa, --fingerprint and --check-range do not apply to --diff\n");
+		goto err;
+	}
+
+	/* Whether the fingerprint is printed or embedded in the listing. */
+	if (fingerprint || (!mode && emits_fingerprint(emitter, outputs,
+						       nr_outputs)))
+		read_opts.flags |= IOMMU_READ_FINGERPRINT;
+
+	if (query.flags && !aggregate_dir) {
+		fprintf(stderr, "error: query options require --aggregate\n");
+		goto err;
+	}
+
+	/* Aggregation works on the snapshots only and never reads sysfs. */
+	if (aggregate_dir) {
+		if (aggregate(aggregate_dir, style, &query))
+			goto err;
+		goto out;
+	}
+
+	if (diff_path) {
+		ret = load_groups(diff_path, &baseline);
+		if (ret) {
+			fprintf(stderr, "error: cannot load '%s': %s\n",
+				diff_path, strerror(-ret));
+			goto err;
+		}
+
+		iommu_groups_sort(baseline.groups, baseline.nr_groups);
+	}
+
+	backend = iommu_backend_find(backend_name);
+	if (!backend) {
+		fprintf(stderr, "error: backend '%s' is not available\n",
+			backend_name);
 		goto err;
 	}
 
-	if (!iommu_groups_read(groups, &nr_groups, IOMMU_NR_GROUPS)) {
+	if (!iommu_groups_read(backend, &read_opts, &list)) {
 		fprintf(stderr, "iommu read error\n");
 		goto err;
 	}
 
-	if (strcmp(format, "json") == 0)
-		ret = print_json(groups, nr_groups);
-	else
-		ret = print_plain(groups, nr_groups);
+	if (diff_path) {
+		ret = print_diff(style, &baseline, &list);
+		if (ret < 0) {
+			fprintf(stderr, "print error: %s\n", strerror(-ret));
+			goto err;
+		}
+
+		/* Like diff(1), exit with 1 when the topology has changed. */
+		iommu_groups_free(&baseline);
+		iommu_groups_free(&list);
+		return ret > 0;
+	}
+
+	if (check_range) {
+		ret = print_collisions(style, list.groups, list.nr_groups,
+				       range_start, range_end);
+		if (ret < 0) {
+			fprintf(stderr, "print error: %s\n", strerror(-ret));
+			goto err;
+		}
 
+		/* Exit with 1 when the range collides with a region. */
+		iommu_groups_free(&list);
+		return ret > 0;
+	}
+
+	if (nr_outputs) {
+		if (write_outputs(outputs, nr_outputs, &list))
+			goto err;
+		goto out;
+	}
+
+	if (fingerprint)
+		ret = print_fingerprint(&list);
+	else if (select)
+		ret = print_selection(style, &selector, list.groups,
+				      list.nr_groups);
+	else
+		ret = print_groups(emitter, STDOUT_FILENO, &list);
 	if (ret) {
 		fprintf(stderr, "print error: %s\n", strerror(-ret));
 		goto err;
 	}
 
 out:
-	free(groups);
+	iommu_groups_free(&list);
 	return 0;
 
 err:
 	fprintf(stderr, "Try '%s --help' for more information.\n",
 		process_name);
-	free(groups);
-	return 1;
+	iommu_groups_free(&baseline);
+	iommu_groups_free(&list);
+	return diff_path || check_range ? 2 : 1;
 }
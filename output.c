@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+
+#define OUTPUT_DYNAMIC_MIN 4096
+#define OUTPUT_IOV_BATCH 64
+
+#define HEX_ROW(h)							\
+	h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7"			\
+	h "8" h "9" h "a" h "b" h "c" h "d" h "e" h "f"
+
+#define DEC_ROW(d)							\
+	d "0" d "1" d "2" d "3" d "4" d "5" d "6" d "7" d "8" d "9"
+
+static const char hex_pairs[512] =
+	HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3")
+	HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+	HEX_ROW("8") HEX_ROW("9") HEX_ROW("a") HEX_ROW("b")
+	HEX_ROW("c") HEX_ROW("d") HEX_ROW("e") HEX_ROW("f");
+
+static const char dec_pairs[200] =
+	DEC_ROW("0") DEC_ROW("1") DEC_ROW("2") DEC_ROW("3") DEC_ROW("4")
+	DEC_ROW("5") DEC_ROW("6") DEC_ROW("7") DEC_ROW("8") DEC_ROW("9");
+
+char *output_encode_hex(char *dst, uint32_t value, unsigned int digits)
+{
+	char *p = dst + digits;
+
+	while (p - dst >= 2) {
+		p -= 2;
+		memcpy(p, &hex_pairs[(value & 0xff) * 2], 2);
+		value >>= 8;
+	}
+
+	if (p > dst)
+		*--p = hex_pairs[(value & 0xf) * 2 + 1];
+
+	return dst + digits;
+}
+
+char *output_encode_dec(char *dst, uint32_t value, unsigned int width)
+{
+	char tmp[10];
+	char *p = tmp + sizeof(tmp);
+	unsigned int len;
+
+	while (value >= 100) {
+		p -= 2;
+		memcpy(p, &dec_pairs[(value % 100) * 2], 2);
+		value /= 100;
+	}
+
+	if (value >= 10) {
+		p -= 2;
+		memcpy(p, &dec_pairs[value * 2], 2);
+	} else {
+		*--p = '0' + value;
+	}
+
+	len = tmp + sizeof(tmp) - p;
+	for (; width > len; width--)
+		*dst++ = '0';
+
+	memcpy(dst, p, len);
+	return dst + len;
+}
+
+void output_init(struct output *out, int fd, void *buf, size_t size)
+{
+	out->fd = fd;
+	out->error = 0;
+	out->length = 0;
+	out->capacity = size;
+	out->data = buf;
+}
+
+void output_init_dynamic(struct output *out)
+{
+	output_init(out, -1, NULL, 0);
+}
+
+void output_release(struct output *out)
+{
+	if (out->fd < 0)
+		free(out->data);
+
+	out->data = NULL;
+	out->length = 0;
+	out->capacity = 0;
+}
+
+/* Makes room for at least @len more bytes in a dynamic buffer. */
+static int output_grow(struct output *out, size_t len)
+{
+	size_t capacity = out->capacity * 2;
+	uint8_t *data;
+
+	if (capacity < out->length + len)
+		capacity = out->length + len;
+	if (capacity < OUTPUT_DYNAMIC_MIN)
+		capacity = OUTPUT_DYNAMIC_MIN;
+
+	data = realloc(out->data, capacity);
+	if (!data) {
+		out->error = -ENOMEM;
+		return out->error;
+	}
+
+	out->data = data;
+	out->capacity = capacity;
+	return 0;
+}
+
+int output_flush(struct output *out)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	if (out->fd < 0)
+		return out->error;
+
+	while (done < out->length && !out->error) {
+		ret = write(out->fd, out->data + done, out->length - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			out->error = -errno;
+			break;
+		}
+
+		done += ret;
+	}
+
+	out->length = 0;
+	return out->error;
+}
+
+/*
+ * Returns a pointer to at least @len free bytes at the end of the buffer,
+ * flushing first if needed. @len must be small compared to the capacity.
+ */
+static char *output_reserve(struct output *out, size_t len)
+{
+	if (out->error)
+		return NULL;
+
+	if (out->capacity - out->length < len) {
+		if (out->fd < 0 ? output_grow(out, len) : output_flush(out))
+			return NULL;
+	}
+
+	return (char *)out->data + out->length;
+}
+
+void output_write(struct output *out, const void *src, size_t len)
+{
+	const uint8_t *p = src;
+	size_t n;
+
+	if (out->fd < 0 && out->capacity - out->length < len &&
+	    output_grow(out, len) < 0)
+		return;
+
+	while (len > 0) {
+		if (out->error)
+			return;
+
+		if (out->length == out->capacity && output_flush(out) < 0)
+			return;
+
+		n = out->capacity - out->length;
+		if (n > len)
+			n = len;
+
+		memcpy(out->data + out->length, p, n);
+		out->length += n;
+		p += n;
+		len -= n;
+	}
+}
+
+void output_str(struct output *out, const char *str)
+{
+	output_write(out, str, strlen(str));
+}
+
+void output_char(struct output *out, char c)
+{
+	char *p = output_reserve(out, 1);
+
+	if (!p)
+		return;
+
+	*p = c;
+	out->length++;
+}
+
+void output_hex(struct output *out, uint32_t value, unsigned int digits)
+{
+	char *p = output_reserve(out, digits);
+
+	if (!p)
+		return;
+
+	out->length += output_encode_hex(p, value, digits) - p;
+}
+
+void output_dec(struct output *out, uint32_t value, unsigned int width)
+{
+	char *p = output_reserve(out, width > 10 ? width : 10);
+
+	if (!p)
+		return;
+
+	out->length += output_encode_dec(p, value, width) - p;
+}
+
+void output_pci_addr(struct output *out, uint32_t addr)
+{
+	char *start = output_reserve(out, 12);
+	char *p = start;
+
+	if (!p)
+		return;
+
+	p = output_encode_hex(p, (addr >> 16) & 0xffff, 4);
+	*p++ = ':';
+	p = output_encode_hex(p, (addr >> 8) & 0xff, 2);
+	*p++ = ':';
+	p = output_encode_hex(p, (addr >> 3) & 0x1f, 2);
+	*p++ = '.';
+	p = output_encode_hex(p, addr & 0x7, 1);
+
+	out->length += p - start;
+}
+
+/*
+ * Writes dynamic buffers to @fd in order, with one writev() per batch of
+ * buffers.
+ */
+int output_write_buffers(int fd, const struct output *bufs, unsigned int nr)
+{
+	struct iovec iov[OUTPUT_IOV_BATCH];
+	unsigned int i = 0, nr_iov;
+	ssize_t ret;
+
+	while (i < nr) {
+		for (nr_iov = 0; nr_iov < OUTPUT_IOV_BATCH && i < nr; i++) {
+			if (!bufs[i].length)
+				continue;
+
+			iov[nr_iov].iov_base = bufs[i].data;
+			iov[nr_iov].iov_len = bufs[i].length;
+			nr_iov++;
+		}
+
+		while (nr_iov > 0) {
+			ret = writev(fd, iov, nr_iov);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				return -errno;
+			}
+
+			/* Skip what a short write consumed. */
+			while (nr_iov > 0 && (size_t)ret >= iov[0].iov_len) {
+				ret -= iov[0].iov_len;
+				memmove(iov, iov + 1, --nr_iov * sizeof(iov[0]));
+			}
+
+			if (nr_iov > 0) {
+				iov[0].iov_base = (uint8_t *)iov[0].iov_base + ret;
+				iov[0].iov_len -= ret;
+			}
+		}
+	}
+
+	return 0;
+}
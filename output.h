@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+/*
+ * Output buffer that collects whole records and flushes them to a file
+ * descriptor with a single write() per filled buffer. A buffer created
+ * with output_init_dynamic() has no file descriptor, and grows instead.
+ */
+struct output {
+	int fd;
+	int error;
+	size_t length;
+	size_t capacity;
+	uint8_t *data;
+};
+
+void output_init(struct output *out, int fd, void *buf, size_t size);
+void output_init_dynamic(struct output *out);
+void output_release(struct output *out);
+int output_flush(struct output *out);
+int output_write_buffers(int fd, const struct output *bufs, unsigned int nr);
+void output_write(struct output *out, const void *src, size_t len);
+void output_str(struct output *out, const char *str);
+void output_char(struct output *out, char c);
+void output_hex(struct output *out, uint32_t value, unsigned int digits);
+void output_dec(struct output *out, uint32_t value, unsigned int width);
+void output_pci_addr(struct output *out, uint32_t addr);
+
+char *output_encode_hex(char *dst, uint32_t value, unsigned int digits);
+char *output_encode_dec(char *dst, uint32_t value, unsigned int width);
+
+#endif /* OUTPUT_H */
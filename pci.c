@@ -5,12 +5,12 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <string.h>
 
+#include "output.h"
 #include "pci.h"
-#include "string-buffer.h"
 
 static int parse_hex_digit(char src, uint32_t *value)
 {
@@ -45,6 +45,20 @@ static int parse_hex(const char *src, int len, uint32_t *value)
 	return 0;
 }
 
+int pci_property_to_u32(const char *prop, uint32_t *value)
+{
+	size_t len;
+
+	if (prop[0] != '0' || (prop[1] != 'x' && prop[1] != 'X'))
+		return -EINVAL;
+
+	len = strnlen(prop + 2, 9);
+	if (len == 0 || len > 8)
+		return -EINVAL;
+
+	return parse_hex(prop + 2, len, value);
+}
+
 int pci_string_to_addr(const char *sysname, uint32_t *addr)
 {
 	unsigned int domain = 0;
@@ -80,31 +94,148 @@ int pci_string_to_addr(const char *sysname, uint32_t *addr)
 
 void pci_addr_to_string(uint32_t addr, char *out, size_t size)
 {
-	unsigned int domain = (addr >> 16) & 0xffff;
-	unsigned int bus = (addr >> 8) & 0xff;
-	unsigned int slot = (addr >> 3) & 0x1f;
-	unsigned int func = addr & 0x7;
+	char tmp[PCI_ADDR_STRING_SIZE];
+	char *p = tmp;
+
+	if (size == 0)
+		return;
+
+	p = output_encode_hex(p, (addr >> 16) & 0xffff, 4);
+	*p++ = ':';
+	p = output_encode_hex(p, (addr >> 8) & 0xff, 2);
+	*p++ = ':';
+	p = output_encode_hex(p, (addr >> 3) & 0x1f, 2);
+	*p++ = '.';
+	p = output_encode_hex(p, addr & 0x7, 1);
+	*p = '\0';
+
+	if (size > sizeof(tmp))
+		size = sizeof(tmp);
+
+	memcpy(out, tmp, size - 1);
+	out[size - 1] = '\0';
+}
+
+/* Parses "8.0 GT/s PCIe" and alike to units of 0.1 GT/s. */
+int pci_parse_link_speed(const char *str, uint16_t *speed)
+{
+	unsigned int whole = 0;
+	unsigned int tenths = 0;
+
+	if (*str < '0' || *str > '9')
+		return -EINVAL;
+
+	for (; *str >= '0' && *str <= '9'; str++) {
+		whole = whole * 10 + *str - '0';
+		if (whole > 1000)
+			return -EINVAL;
+	}
+
+	if (*str == '.') {
+		str++;
+		if (*str >= '0' && *str <= '9')
+			tenths = *str - '0';
+		while (*str >= '0' && *str <= '9')
+			str++;
+	}
+
+	if (strncmp(str, " GT/s", 5))
+		return -EINVAL;
+
+	*speed = whole * 10 + tenths;
+	return 0;
+}
+
+char *pci_encode_link_speed(char *dst, uint16_t speed)
+{
+	dst = output_encode_dec(dst, speed / 10, 0);
+	*dst++ = '.';
+	return output_encode_dec(dst, speed % 10, 0);
+}
+
+static uint16_t pci_config_u16(const uint8_t *config, size_t offset)
+{
+	return config[offset] | config[offset + 1] << 8;
+}
 
-	snprintf(out, size, "%04x:%02x:%02x.%d", domain, bus, slot, func);
+static uint32_t pci_config_u32(const uint8_t *config, size_t offset)
+{
+	return (uint32_t)pci_config_u16(config, offset) |
+	       (uint32_t)pci_config_u16(config, offset + 2) << 16;
 }
 
-void string_buffer_to_pci(struct string_buffer *out, struct pci_device *props)
+/* Returns whether the capability list has a PCI Express capability. */
+static bool pci_config_is_express(const uint8_t *config, size_t size)
 {
-	char addr_str[32];
-
-	pci_addr_to_string(props->addr, addr_str, sizeof(addr_str));
-
-	string_buffer_append(out, "Address ");
-	string_buffer_append(out, addr_str);
-	string_buffer_append(out, " Class ");
-	string_buffer_append(out, props->class + 2);
-	string_buffer_append(out, " ID ");
-	string_buffer_append(out, props->vendor + 2);
-	string_buffer_append(out, ":");
-	string_buffer_append(out, props->device + 2);
-
-	if (props->has_revision) {
-		string_buffer_append(out, " Revision ");
-		string_buffer_append(out, props->revision + 2);
+	unsigned int ttl = 48;
+	size_t pos;
+
+	pos = config[PCI_CAPABILITY_LIST] & ~3;
+	while (pos >= 0x40 && pos + 1 < size && ttl--) {
+		if (config[pos] == PCI_CAP_ID_EXP)
+			return true;
+		pos = config[pos + 1] & ~3;
+	}
+
+	return false;
+}
+
+/*
+ * Walks the capability lists of a configuration space image of @size
+ * bytes. Only PCI Express functions have extended capabilities. When the
+ * lists are cut off, as they are for unprivileged readers, or do not end,
+ * @acs is left unread.
+ */
+void pci_config_read_acs(const uint8_t *config, size_t size,
+			 struct pci_acs *acs)
+{
+	unsigned int ttl = (PCI_CONFIG_SIZE - PCI_EXT_CAP_START) / 8;
+	size_t pos = PCI_EXT_CAP_START;
+	uint32_t header;
+
+	acs->flags = 0;
+
+	if (size < 0x40)
+		return;
+
+	if (!(pci_config_u16(config, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+		acs->flags = PCI_ACS_READ;
+		return;
+	}
+
+	if (size < PCI_EXT_CAP_START)
+		return;
+
+	if (!pci_config_is_express(config, size)) {
+		acs->flags = PCI_ACS_READ;
+		return;
+	}
+
+	/* Only a terminated list tells that there is no ACS capability. */
+	while (ttl--) {
+		if (pos + 8 > size)
+			return;
+
+		header = pci_config_u32(config, pos);
+		if (header == 0 || header == 0xffffffff) {
+			acs->flags = PCI_ACS_READ;
+			return;
+		}
+
+		if ((header & 0xffff) == PCI_EXT_CAP_ID_ACS) {
+			acs->cap = pci_config_u16(config, pos + PCI_ACS_CAP);
+			acs->ctrl = pci_config_u16(config, pos + PCI_ACS_CTRL);
+			acs->flags = PCI_ACS_READ | PCI_ACS_PRESENT;
+			return;
+		}
+
+		pos = (header >> 20) & ~3;
+		if (pos == 0) {
+			acs->flags = PCI_ACS_READ;
+			return;
+		}
+
+		if (pos < PCI_EXT_CAP_START)
+			return;
 	}
 }
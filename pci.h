@@ -11,8 +11,88 @@
 #include <stddef.h>
 
 #define PCI_PROPERTY_SIZE 16
+#define PCI_ADDR_STRING_SIZE 13
+#define PCI_CPULIST_SIZE 64
+#define PCI_LINK_SPEED_STRING_SIZE 16
+#define PCI_DRIVER_SIZE 32
 
-struct string_buffer;
+#define PCI_STATUS 0x06
+#define PCI_STATUS_CAP_LIST 0x10
+#define PCI_HEADER_TYPE 0x0e
+#define PCI_HEADER_TYPE_MASK 0x7f
+#define PCI_HEADER_TYPE_NORMAL 0
+#define PCI_CAPABILITY_LIST 0x34
+#define PCI_CAP_ID_EXP 0x10
+
+#define PCI_CONFIG_SIZE 4096
+#define PCI_EXT_CAP_START 0x100
+#define PCI_EXT_CAP_ID_ACS 0x0d
+#define PCI_ACS_CAP 0x04
+#define PCI_ACS_CTRL 0x06
+
+enum pci_locality_flag {
+	PCI_LOCALITY_NUMA = 0x01,
+	PCI_LOCALITY_CPULIST = 0x02,
+	PCI_LOCALITY_LINK = 0x04,
+};
+
+/*
+ * NUMA and PCIe link attributes. @flags tells which fields are valid.
+ * @link_speed is in units of 0.1 GT/s.
+ */
+struct pci_locality {
+	uint8_t flags;
+	uint8_t link_width;
+	uint16_t link_speed;
+	int16_t numa_node;
+	char cpulist[PCI_CPULIST_SIZE];
+};
+
+enum pci_binding_flag {
+	PCI_BINDING_DRIVER = 0x01,
+	PCI_BINDING_HEADER = 0x02,
+};
+
+/*
+ * Driver binding and configuration header type. With PCI_BINDING_DRIVER
+ * set, an empty @driver means that the device is not bound.
+ */
+struct pci_binding {
+	uint8_t flags;
+	uint8_t header_type;
+	char driver[PCI_DRIVER_SIZE];
+};
+
+enum pci_sriov_flag {
+	PCI_SRIOV_PHYSFN = 0x01,
+	PCI_SRIOV_VIRTFN = 0x02,
+};
+
+/*
+ * SR-IOV relationship. A physical function has @nr_virtfn virtual
+ * functions, and a virtual function belongs to the function at @physfn.
+ */
+struct pci_sriov {
+	uint8_t flags;
+	uint16_t nr_virtfn;
+	uint32_t physfn;
+};
+
+enum pci_acs_flag {
+	PCI_ACS_READ = 0x01,
+	PCI_ACS_PRESENT = 0x02,
+};
+
+/*
+ * Access Control Services registers. PCI_ACS_READ tells that the
+ * capability lists were walked, and PCI_ACS_PRESENT that the capability
+ * was found and @cap and @ctrl are valid.
+ */
+struct pci_acs {
+	uint8_t flags;
+	uint16_t cap;
+	uint16_t ctrl;
+};
 
 struct pci_device {
 	uint32_t addr;
@@ -22,10 +102,18 @@ struct pci_device {
 	char device[PCI_PROPERTY_SIZE];
 	char revision[PCI_PROPERTY_SIZE];
 	bool has_revision;
+	struct pci_locality locality;
+	struct pci_binding binding;
+	struct pci_sriov sriov;
+	struct pci_acs acs;
 };
 
+int pci_property_to_u32(const char *prop, uint32_t *value);
 int pci_string_to_addr(const char *sysname, uint32_t *addr);
 void pci_addr_to_string(uint32_t addr, char *out, size_t size);
-void string_buffer_to_pci(struct string_buffer *out, struct pci_device *dev);
+int pci_parse_link_speed(const char *str, uint16_t *speed);
+char *pci_encode_link_speed(char *dst, uint16_t speed);
+void pci_config_read_acs(const uint8_t *config, size_t size,
+			 struct pci_acs *acs);
 
 #endif /* PCI_H */
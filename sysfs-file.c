@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "string-buffer.h"
+#include "sysfs-file.h"
+
+ssize_t sysfs_read_file(const char *path, char *buf, size_t size)
+{
+	int fd = open(path, O_RDONLY);
+	ssize_t len;
+	int errno_tmp;
+
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, size - 1);
+	errno_tmp = errno;
+	close(fd);
+
+	if (len < 0)
+		return -errno_tmp;
+
+	buf[len] = '\0';
+
+	if (len > 0 && buf[len - 1] == '\n') {
+		buf[len - 1] = '\0';
+		len--;
+	}
+
+	return len;
+}
+
+static int sysfs_attr_path(struct string_buffer *path, const char *dev_path,
+			   const char *attr)
+{
+	string_buffer_append(path, dev_path);
+	string_buffer_append(path, "/");
+	string_buffer_append(path, attr);
+
+	if (path->status & STRING_BUFFER_OVERFLOW)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+ssize_t sysfs_read_attr(const char *dev_path, const char *attr, char *buf,
+			size_t size)
+{
+	STRING_BUFFER(path, PATH_MAX);
+	int ret;
+
+	ret = sysfs_attr_path(path, dev_path, attr);
+	if (ret < 0)
+		return ret;
+
+	return sysfs_read_file((const char *)path->data, buf, size);
+}
+
+/* Reads up to @size bytes of a binary attribute such as "config". */
+ssize_t sysfs_read_binary(const char *dev_path, const char *attr, void *buf,
+			  size_t size)
+{
+	STRING_BUFFER(path, PATH_MAX);
+	size_t done = 0;
+	ssize_t len;
+	int ret;
+	int fd;
+
+	ret = sysfs_attr_path(path, dev_path, attr);
+	if (ret < 0)
+		return ret;
+
+	fd = open((const char *)path->data, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	while (done < size) {
+		len = read(fd, (char *)buf + done, size - done);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			close(fd);
+			return ret;
+		}
+
+		if (len == 0)
+			break;
+
+		done += len;
+	}
+
+	close(fd);
+	return done;
+}
+
+/* Reads the last path component of a symbolic link such as "driver". */
+ssize_t sysfs_read_link_name(const char *dev_path, const char *attr,
+			     char *buf, size_t size)
+{
+	STRING_BUFFER(path, PATH_MAX);
+	char target[PATH_MAX];
+	const char *name;
+	ssize_t len;
+	int ret;
+
+	ret = sysfs_attr_path(path, dev_path, attr);
+	if (ret < 0)
+		return ret;
+
+	len = readlink((const char *)path->data, target, sizeof(target) - 1);
+	if (len < 0)
+		return -errno;
+
+	target[len] = '\0';
+
+	name = strrchr(target, '/');
+	name = name ? name + 1 : target;
+
+	len = strlen(name);
+	if ((size_t)len >= size)
+		return -ENAMETOOLONG;
+
+	memcpy(buf, name, len + 1);
+	return len;
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#ifndef SYSFS_FILE_H
+#define SYSFS_FILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+ssize_t sysfs_read_file(const char *path, char *buf, size_t size);
+ssize_t sysfs_read_attr(const char *dev_path, const char *attr, char *buf,
+			size_t size);
+ssize_t sysfs_read_binary(const char *dev_path, const char *attr, void *buf,
+			  size_t size);
+ssize_t sysfs_read_link_name(const char *dev_path, const char *attr,
+			     char *buf, size_t size);
+
+#endif /* SYSFS_FILE_H */
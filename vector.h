@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Copyright(c) Opinsys Oy 2025
+ */
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdlib.h>
+
+#define VECTOR_MIN_CAPACITY 16
+
+/*
+ * Defines 'struct name', a growable array of @type, together with
+ * name_push() and name_free(). A zeroed struct is an empty vector.
+ */
+#define DEFINE_VECTOR(name, type)					\
+struct name {								\
+	type *items;							\
+	unsigned int nr_items;						\
+	unsigned int capacity;						\
+};									\
+									\
+/* Returns a new uninitialized item at the end, or NULL. */		\
+static inline type *name##_push(struct name *vec)			\
+{									\
+	unsigned int capacity;						\
+	type *items;							\
+									\
+	if (vec->nr_items == vec->capacity) {				\
+		capacity = vec->capacity ? vec->capacity * 2 :		\
+					   VECTOR_MIN_CAPACITY;		\
+		items = realloc(vec->items, capacity * sizeof(*items));	\
+		if (!items)						\
+			return NULL;					\
+									\
+		vec->items = items;					\
+		vec->capacity = capacity;				\
+	}								\
+									\
+	return &vec->items[vec->nr_items++];				\
+}									\
+									\
+static inline void name##_free(struct name *vec)			\
+{									\
+	free(vec->items);						\
+	vec->items = NULL;						\
+	vec->nr_items = 0;						\
+	vec->capacity = 0;						\
+}
+
+#endif /* VECTOR_H */